@@ -0,0 +1,305 @@
+﻿#pragma once
+#include <vector>
+#include <cstddef>
+#include <GL/glew.h>
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// 一度記録した描画命令の列を再生する
+//
+// 命令は GLuint の語の並びに詰めて格納し、再生するときは仮想関数を介さずに
+// 一つのループで解釈する。フレームごとに変わる uniform ブロックの位置などは
+// 記録し直さずに該当する語だけを書き換える
+//
+class CommandBuffer
+{
+  // 命令の種類
+  enum class Op : GLuint
+  {
+    UseProgram,             // program
+    BindVertexArray,        // vao
+    BindBufferRange,        // target, index, buffer, offset, size
+    Enable,                 // cap
+    Disable,                // cap
+    PrimitiveRestartIndex,  // index
+    DrawArrays,             // mode, first, count
+    DrawElements,           // mode, count, type, offset
+    MultiDrawElements       // mode, type, 範囲の先頭の番号, 範囲の数
+  };
+
+  // 命令の語の並び
+  std::vector<GLuint> code;
+
+  // glMultiDrawElements() に渡す範囲ごとのインデックスの数と先頭位置
+  std::vector<GLsizei> count;
+  std::vector<const GLvoid *> first;
+
+  // 記録した命令の数
+  std::size_t commands;
+
+  // このコマンドバッファを再生した回数と書き換えた命令の数
+  mutable unsigned long long replays;
+  unsigned long long patches;
+
+  // 命令を追加する
+  //   op: 命令の種類
+  void emit(Op op)
+  {
+    code.emplace_back(static_cast<GLuint>(op));
+    ++commands;
+  }
+
+  // コピーコンストラクタによるコピー禁止
+  CommandBuffer(const CommandBuffer &c);
+
+  // 代入によるコピー禁止
+  CommandBuffer &operator=(const CommandBuffer &c);
+
+public:
+
+  // 書き換えられる命令の位置
+  typedef std::size_t Slot;
+
+  // 統計
+  struct Stats
+  {
+    // 再生した回数
+    unsigned long long replays;
+
+    // 再生した命令の数
+    unsigned long long commands;
+
+    // 書き換えた命令の数
+    unsigned long long patches;
+  };
+
+  // コンストラクタ
+  CommandBuffer()
+    : commands(0), replays(0), patches(0)
+  {
+  }
+
+  // 記録を消去する
+  void clear()
+  {
+    code.clear();
+    count.clear();
+    first.clear();
+    commands = 0;
+  }
+
+  // 何も記録していなければ true
+  bool empty() const
+  {
+    return code.empty();
+  }
+
+  // 記録した命令の数を取り出す
+  std::size_t size() const
+  {
+    return commands;
+  }
+
+  // プログラムオブジェクトの使用を記録する
+  //   program: プログラムオブジェクト名
+  void useProgram(GLuint program)
+  {
+    emit(Op::UseProgram);
+    code.emplace_back(program);
+  }
+
+  // 頂点配列オブジェクトの結合を記録する
+  //   vao: 頂点配列オブジェクト名
+  void bindVertexArray(GLuint vao)
+  {
+    emit(Op::BindVertexArray);
+    code.emplace_back(vao);
+  }
+
+  // バッファオブジェクトの範囲の結合を記録する
+  //   target: 結合ターゲット
+  //   index: 結合ポイント
+  //   buffer: バッファオブジェクト名
+  //   offset: 結合する範囲の先頭
+  //   size: 結合する範囲のサイズ
+  //   戻り値: patch() でバッファオブジェクトと範囲の先頭を書き換えるときの位置
+  Slot bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+  {
+    emit(Op::BindBufferRange);
+    const Slot slot(code.size() + 2);
+    code.emplace_back(target);
+    code.emplace_back(index);
+    code.emplace_back(buffer);
+    code.emplace_back(static_cast<GLuint>(offset));
+    code.emplace_back(static_cast<GLuint>(size));
+    return slot;
+  }
+
+  // 機能を有効にすることを記録する
+  //   cap: 機能
+  void enable(GLenum cap)
+  {
+    emit(Op::Enable);
+    code.emplace_back(cap);
+  }
+
+  // 機能を無効にすることを記録する
+  //   cap: 機能
+  void disable(GLenum cap)
+  {
+    emit(Op::Disable);
+    code.emplace_back(cap);
+  }
+
+  // 基本図形を再開するインデックスの設定を記録する
+  //   index: 基本図形を再開するインデックス
+  void primitiveRestartIndex(GLuint index)
+  {
+    emit(Op::PrimitiveRestartIndex);
+    code.emplace_back(index);
+  }
+
+  // glDrawArrays() による描画を記録する
+  //   mode: 基本図形の種類
+  //   start: 先頭の頂点の番号
+  //   n: 頂点の数
+  void drawArrays(GLenum mode, GLint start, GLsizei n)
+  {
+    emit(Op::DrawArrays);
+    code.emplace_back(mode);
+    code.emplace_back(static_cast<GLuint>(start));
+    code.emplace_back(static_cast<GLuint>(n));
+  }
+
+  // glDrawElements() による描画を記録する
+  //   mode: 基本図形の種類
+  //   n: インデックスの数
+  //   type: インデックスの型
+  //   offset: インデックスのバッファオブジェクト中の先頭位置
+  void drawElements(GLenum mode, GLsizei n, GLenum type, GLintptr offset)
+  {
+    emit(Op::DrawElements);
+    code.emplace_back(mode);
+    code.emplace_back(static_cast<GLuint>(n));
+    code.emplace_back(type);
+    code.emplace_back(static_cast<GLuint>(offset));
+  }
+
+  // glMultiDrawElements() による描画を記録する
+  //   mode: 基本図形の種類
+  //   n: 範囲ごとのインデックスの数
+  //   type: インデックスの型
+  //   offset: 範囲ごとのインデックスのバッファオブジェクト中の先頭位置
+  //   ranges: 範囲の数
+  void multiDrawElements(GLenum mode, const GLsizei *n, GLenum type,
+    const GLvoid *const *offset, GLsizei ranges)
+  {
+    if (ranges <= 0) return;
+    emit(Op::MultiDrawElements);
+    code.emplace_back(mode);
+    code.emplace_back(type);
+    code.emplace_back(static_cast<GLuint>(count.size()));
+    code.emplace_back(static_cast<GLuint>(ranges));
+    count.insert(count.end(), n, n + ranges);
+    first.insert(first.end(), offset, offset + ranges);
+  }
+
+  // 記録したバッファオブジェクトの範囲の結合を書き換える
+  //   slot: bindBufferRange() の戻り値
+  //   buffer: バッファオブジェクト名
+  //   offset: 結合する範囲の先頭
+  void patch(Slot slot, GLuint buffer, GLintptr offset)
+  {
+    code[slot] = buffer;
+    code[slot + 1] = static_cast<GLuint>(offset);
+    ++patches;
+    ++stats().patches;
+  }
+
+  // 記録した命令を再生する
+  void replay() const
+  {
+    State &state(State::get());
+    const GLuint *p(code.data());
+    const GLuint *const end(p + code.size());
+
+    while (p < end)
+    {
+      switch (static_cast<Op>(*p++))
+      {
+      case Op::UseProgram:
+        state.useProgram(p[0]);
+        p += 1;
+        break;
+
+      case Op::BindVertexArray:
+        state.bindVertexArray(p[0]);
+        p += 1;
+        break;
+
+      case Op::BindBufferRange:
+        state.bindBufferRange(p[0], p[1], p[2], p[3], p[4]);
+        p += 5;
+        break;
+
+      case Op::Enable:
+        state.enable(p[0]);
+        p += 1;
+        break;
+
+      case Op::Disable:
+        state.disable(p[0]);
+        p += 1;
+        break;
+
+      case Op::PrimitiveRestartIndex:
+        glPrimitiveRestartIndex(p[0]);
+        p += 1;
+        break;
+
+      case Op::DrawArrays:
+        glDrawArrays(p[0], static_cast<GLint>(p[1]), static_cast<GLsizei>(p[2]));
+        p += 3;
+        break;
+
+      case Op::DrawElements:
+        glDrawElements(p[0], static_cast<GLsizei>(p[1]), p[2],
+          static_cast<const char *>(0) + p[3]);
+        p += 4;
+        break;
+
+      case Op::MultiDrawElements:
+        glMultiDrawElements(p[0], count.data() + p[2], p[1],
+          first.data() + p[2], static_cast<GLsizei>(p[3]));
+        p += 4;
+        break;
+      }
+    }
+
+    ++replays;
+    Stats &s(stats());
+    ++s.replays;
+    s.commands += commands;
+  }
+
+  // このコマンドバッファを再生した回数を取り出す
+  unsigned long long getReplayCount() const
+  {
+    return replays;
+  }
+
+  // このコマンドバッファで書き換えた命令の数を取り出す
+  unsigned long long getPatchCount() const
+  {
+    return patches;
+  }
+
+  // 全てのコマンドバッファを合わせた再生の統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
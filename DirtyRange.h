@@ -0,0 +1,67 @@
+﻿#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <GL/glew.h>
+
+//
+// 書き換えた範囲
+//
+class DirtyRange
+{
+  // 書き換えた範囲の先頭位置と末尾の次の位置
+  std::vector<std::pair<GLsizei, GLsizei>> range;
+
+public:
+
+  // 書き換えた範囲を追加する
+  //   first: 範囲の先頭位置
+  //   count: 範囲の要素数
+  void mark(GLsizei first, GLsizei count)
+  {
+    if (count <= 0) return;
+
+    // 直前の範囲に重なるか続いていれば一つにまとめる
+    if (!range.empty() && first <= range.back().second && first + count >= range.back().first)
+    {
+      range.back().first = std::min(range.back().first, first);
+      range.back().second = std::max(range.back().second, first + count);
+    }
+    else
+      range.emplace_back(first, first + count);
+  }
+
+  // 書き換えた範囲を並べ替えて近いものをまとめる
+  //   gap: これより間が短い範囲は一つにまとめる
+  //   戻り値: まとめた範囲
+  const std::vector<std::pair<GLsizei, GLsizei>> &coalesce(GLsizei gap)
+  {
+    if (range.size() > 1)
+    {
+      std::sort(range.begin(), range.end());
+      std::size_t n(0);
+      for (std::size_t i = 1; i < range.size(); ++i)
+      {
+        if (range[i].first <= range[n].second + gap)
+          range[n].second = std::max(range[n].second, range[i].second);
+        else
+          range[++n] = range[i];
+      }
+      range.resize(n + 1);
+    }
+
+    return range;
+  }
+
+  // 書き換えた範囲がなければ true
+  bool empty() const
+  {
+    return range.empty();
+  }
+
+  // 書き換えた範囲を空にする
+  void clear()
+  {
+    range.clear();
+  }
+};
@@ -0,0 +1,216 @@
+﻿#pragma once
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <GL/glew.h>
+
+// 図形の描画
+#include "Shape.h"
+
+// 描画命令の記録
+#include "CommandBuffer.h"
+
+// 描画ごとの変換行列
+#include "Transform.h"
+
+// フレームごとに使い捨てる uniform ブロック
+#include "UniformRing.h"
+
+// 視錐台
+#include "Frustum.h"
+
+// 並列処理
+#include "Parallel.h"
+
+//
+// 多数の図形の描画命令を複数のスレッドで作り OpenGL のスレッドでまとめて発行する
+//
+// 図形を区画に分け、区画ごとに変換行列の積、法線ベクトルの変換行列、視錐台による
+// 選別、uniform ブロックの詰め込み、描画命令の記録を別のスレッドで行う。
+// OpenGL を呼び出すのは submit() だけで、区画ごとの uniform ブロックを一度に
+// 書き込んで描画命令の結合位置を書き換えてから区画の順に再生する
+//
+class DrawList
+{
+  // 登録した図形
+  struct Item
+  {
+    // 描画する図形
+    const Shape *shape;
+
+    // 材質の番号
+    GLint material;
+
+    // ワールド座標系での境界球の半径
+    GLfloat radius;
+  };
+
+  // 一つのスレッドが受け持つ区画
+  struct Partition
+  {
+    // 描画命令
+    CommandBuffer commands;
+
+    // 描画命令の中の変換行列の結合位置
+    std::vector<CommandBuffer::Slot> slot;
+
+    // 変換行列を境界にそろえて並べた uniform ブロック
+    std::vector<char> staging;
+  };
+
+  // 登録した図形
+  std::vector<Item> item;
+
+  // 区画
+  std::vector<Partition> partition;
+
+  // uniform ブロックの間隔
+  GLsizeiptr stride;
+
+  // 変換行列を結合する結合ポイント
+  const GLuint bp;
+
+  // 統計を更新するときの排他制御
+  static std::mutex &mutex()
+  {
+    static std::mutex m;
+    return m;
+  }
+
+  // コピーコンストラクタによるコピー禁止
+  DrawList(const DrawList &d);
+
+  // 代入によるコピー禁止
+  DrawList &operator=(const DrawList &d);
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 選別で残った図形の数
+    unsigned long long visible;
+
+    // 視錐台の外にあって除いた図形の数
+    unsigned long long culled;
+
+    // 発行した区画の数
+    unsigned long long partitions;
+  };
+
+  // コンストラクタ
+  //   bp: 変換行列を結合する結合ポイント
+  //   partitions: 区画の数 (0 ならハードウェアスレッドの数)
+  DrawList(GLuint bp, unsigned int partitions = 0)
+    : partition(std::max(1u, partitions > 0 ? partitions : std::thread::hardware_concurrency()))
+    , bp(bp)
+  {
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride = ((sizeof (Transform) - 1) / alignment + 1) * alignment;
+  }
+
+  // 図形を登録する
+  //   shape: 描画する図形 (DrawList より後まで残っていること)
+  //   material: 材質の番号
+  //   radius: ワールド座標系での境界球の半径
+  void add(const Shape &shape, GLint material, GLfloat radius)
+  {
+    const Item i = { &shape, material, radius };
+    item.emplace_back(i);
+  }
+
+  // 登録した図形の数を取り出す
+  std::size_t size() const
+  {
+    return item.size();
+  }
+
+  // 区画の数を取り出す
+  std::size_t getPartitionCount() const
+  {
+    return partition.size();
+  }
+
+  // 描画命令を作る (OpenGL は呼び出さない)
+  //   projection: 投影変換行列
+  //   view: ビュー変換行列
+  //   model: 図形の番号からモデル変換行列を求める関数 (複数のスレッドから呼び出す)
+  template <typename Model>
+  void build(const Matrix &projection, const Matrix &view, Model model)
+  {
+    const Frustum frustum(projection * view);
+    const int n(static_cast<int>(item.size()));
+    const int parts(static_cast<int>(partition.size()));
+
+    parallelFor(0, parts, [&](int begin, int end)
+    {
+      for (int p = begin; p < end; ++p)
+      {
+        Partition &part(partition[p]);
+        part.commands.clear();
+        part.slot.clear();
+        part.staging.clear();
+
+        unsigned long long culled(0);
+        for (int i = n * p / parts; i < n * (p + 1) / parts; ++i)
+        {
+          // 境界球が視錐台の外にあれば描かない
+          const Matrix m(model(i));
+          const GLfloat center[] = { m[12], m[13], m[14] };
+          if (!frustum.sphere(center, item[i].radius))
+          {
+            ++culled;
+            continue;
+          }
+
+          // 変換行列を uniform ブロックの間隔で詰める
+          const Transform t(view * m, item[i].material);
+          const std::size_t where(part.staging.size());
+          part.staging.resize(where + stride);
+          std::memcpy(part.staging.data() + where, &t, sizeof t);
+
+          // 結合位置は submit() で書き換える
+          part.slot.emplace_back(part.commands.bindBufferRange(GL_UNIFORM_BUFFER, bp,
+            0, static_cast<GLintptr>(where), sizeof (Transform)));
+          item[i].shape->record(part.commands);
+        }
+
+        // 統計は区画ごとに数えてから排他的に足す
+        std::lock_guard<std::mutex> lock(mutex());
+        Stats &s(stats());
+        s.visible += part.slot.size();
+        s.culled += culled;
+      }
+    });
+  }
+
+  // 作った描画命令を区画の順に発行する (OpenGL のスレッドで呼び出す)
+  //   ring: 変換行列を書き込む領域
+  void submit(UniformRing &ring)
+  {
+    for (Partition &part : partition)
+    {
+      if (part.slot.empty()) continue;
+
+      // 区画の uniform ブロックを一度に書き込んで結合位置を書き換える
+      const GLintptr base(ring.allocate(part.staging.data(),
+        static_cast<GLsizeiptr>(part.staging.size())));
+      const GLuint buffer(ring.getBuffer());
+      for (std::size_t i = 0; i < part.slot.size(); ++i)
+        part.commands.patch(part.slot[i], buffer, base + i * stride);
+
+      part.commands.replay();
+      ++stats().partitions;
+    }
+  }
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
@@ -0,0 +1,416 @@
+﻿#pragma once
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#  include <xmmintrin.h>
+#  define DYNAMICBATCH_SSE 1
+#endif
+
+// 図形データ
+#include "Object.h"
+
+// 頂点の溶接
+#include "Weld.h"
+
+// 変換行列
+#include "Matrix.h"
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// 小さな動く図形を CPU で変換して材質に関わらずまとめて描く
+//
+class DynamicBatch
+{
+  // 登録された図形
+  struct Mesh
+  {
+    // 頂点属性の先頭位置
+    GLuint vertexfirst;
+
+    // 頂点の数
+    GLsizei vertexcount;
+
+    // 頂点のインデックスの先頭位置
+    GLuint indexfirst;
+
+    // 頂点のインデックスの要素数
+    GLsizei indexcount;
+  };
+
+  // このフレームに描く図形
+  struct Instance
+  {
+    // 登録された図形の番号
+    unsigned int mesh;
+
+    // モデル変換行列
+    Matrix model;
+
+    // 材質の番号
+    unsigned int material;
+  };
+
+  // 登録された図形の頂点属性
+  std::vector<Object::Vertex> vertex;
+
+  // 登録された図形の頂点のインデックス
+  std::vector<GLuint> index;
+
+  // 登録された図形
+  std::vector<Mesh> mesh;
+
+  // このフレームに描く図形
+  std::vector<Instance> instance;
+
+  // 図形ごとの頂点のインデックスの要素数
+  std::vector<GLsizei> count;
+
+  // 図形ごとの頂点のインデックスの先頭位置
+  std::vector<GLvoid *> first;
+
+  // 図形ごとの頂点の先頭位置
+  std::vector<GLint> basevertex;
+
+  // 頂点配列オブジェクト名
+  GLuint vao;
+
+  // 毎フレーム書き換える頂点バッファオブジェクト名と格納できる頂点の数
+  GLuint vbo;
+  GLsizei capacity;
+
+  // インデックスの頂点バッファオブジェクト名とその要素数
+  GLuint ibo;
+  GLsizei ibocount;
+
+  // まとめて描く図形の頂点の数の上限
+  GLsizei threshold;
+
+  // コピーコンストラクタによるコピー禁止
+  DynamicBatch(const DynamicBatch &b);
+
+  // 代入によるコピー禁止
+  DynamicBatch &operator=(const DynamicBatch &b);
+
+  // 頂点一つあたりのサイズ (頂点属性の後ろに材質の番号を別に並べる)
+  static constexpr GLsizeiptr stride = sizeof (Object::Vertex) + sizeof (GLint);
+
+  // 頂点バッファオブジェクトを作り直す
+  //   n: 格納できる頂点の数
+  void resize(GLsizei n)
+  {
+    ReleaseQueue &queue(ReleaseQueue::get());
+    queue.deleteBuffer(vbo, capacity * stride, GL_STREAM_DRAW);
+    capacity = n;
+
+    // 作り直した頂点バッファオブジェクトを in 変数から参照できるようにする
+    State::get().bindVertexArray(vao);
+    vbo = queue.createBuffer(GL_ARRAY_BUFFER, capacity * stride, NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof (Object::Vertex),
+      static_cast<char *>(0));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof (Object::Vertex),
+      static_cast<char *>(0) + sizeof (GLfloat) * 3);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(2, 1, GL_INT, sizeof (GLint),
+      static_cast<char *>(0) + capacity * sizeof (Object::Vertex));
+    glEnableVertexAttribArray(2);
+  }
+
+  // 登録された図形の頂点のインデックスを転送する
+  void upload()
+  {
+    ReleaseQueue &queue(ReleaseQueue::get());
+    queue.deleteBuffer(ibo, ibocount * sizeof (GLuint), GL_STATIC_DRAW);
+    ibocount = static_cast<GLsizei>(index.size());
+
+    // 頂点配列オブジェクトに結合する
+    State::get().bindVertexArray(vao);
+    ibo = queue.createBuffer(GL_ELEMENT_ARRAY_BUFFER,
+      ibocount * sizeof (GLuint), index.data(), GL_STATIC_DRAW);
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // まとめて描いた図形の数
+    unsigned long long instances;
+
+    // まとめた描画命令の数
+    unsigned long long drawCalls;
+
+    // CPU で変換した頂点の数
+    unsigned long long vertices;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // 頂点属性をモデル変換行列で変換する
+  //   model: モデル変換行列
+  //   src: 変換する頂点属性
+  //   n: 変換する頂点の数
+  //   dst: 変換した頂点属性の格納先
+  static void transform(const Matrix &model, const Object::Vertex *src, GLsizei n,
+    Object::Vertex *dst)
+  {
+    // 法線ベクトルの変換行列
+    GLfloat m[9];
+    model.getNormalMatrix(m);
+
+#if defined(DYNAMICBATCH_SSE)
+    // 変換行列の列
+    const __m128 c0(_mm_loadu_ps(model.data())), c1(_mm_loadu_ps(model.data() + 4));
+    const __m128 c2(_mm_loadu_ps(model.data() + 8)), c3(_mm_loadu_ps(model.data() + 12));
+    const __m128 n0(_mm_setr_ps(m[0], m[1], m[2], 0.0f));
+    const __m128 n1(_mm_setr_ps(m[3], m[4], m[5], 0.0f));
+    const __m128 n2(_mm_setr_ps(m[6], m[7], m[8], 0.0f));
+    const __m128 tiny(_mm_set_ss(1.0e-30f));
+
+    for (GLsizei i = 0; i < n; ++i)
+    {
+      const GLfloat *const p(src[i].position), *const q(src[i].normal);
+
+      // 位置
+      const __m128 v(_mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(c0, _mm_load1_ps(p)), _mm_mul_ps(c1, _mm_load1_ps(p + 1))),
+        _mm_add_ps(_mm_mul_ps(c2, _mm_load1_ps(p + 2)), c3)));
+
+      // 法線ベクトル
+      const __m128 w(_mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(n0, _mm_load1_ps(q)), _mm_mul_ps(n1, _mm_load1_ps(q + 1))),
+        _mm_mul_ps(n2, _mm_load1_ps(q + 2))));
+
+      // 法線ベクトルの長さの二乗を先頭の要素に求めて全要素に広げる
+      const __m128 d(_mm_mul_ps(w, w));
+      const __m128 e(_mm_add_ps(d, _mm_movehl_ps(d, d)));
+      const __m128 s(_mm_max_ss(_mm_add_ss(e, _mm_shuffle_ps(e, e, 1)), tiny));
+      const __m128 l(_mm_sqrt_ss(s));
+      const __m128 u(_mm_div_ps(w, _mm_shuffle_ps(l, l, 0)));
+
+      // 位置は 4 要素書いて 4 要素目を法線ベクトルで上書きする
+      _mm_storeu_ps(dst[i].position, v);
+      _mm_storel_pi(reinterpret_cast<__m64 *>(dst[i].normal), u);
+      _mm_store_ss(dst[i].normal + 2, _mm_movehl_ps(u, u));
+    }
+#else
+    for (GLsizei i = 0; i < n; ++i)
+    {
+      const GLfloat *const p(src[i].position), *const q(src[i].normal);
+      GLfloat w[3];
+
+      for (int k = 0; k < 3; ++k)
+      {
+        dst[i].position[k] = model[k] * p[0] + model[k + 4] * p[1]
+          + model[k + 8] * p[2] + model[k + 12];
+        w[k] = m[k] * q[0] + m[k + 3] * q[1] + m[k + 6] * q[2];
+      }
+
+      // 法線ベクトルを正規化する
+      const GLfloat l(sqrt(std::max(w[0] * w[0] + w[1] * w[1] + w[2] * w[2], 1.0e-30f)));
+      for (int k = 0; k < 3; ++k) dst[i].normal[k] = w[k] / l;
+    }
+#endif
+  }
+
+  // コンストラクタ
+  //   threshold: まとめて描く図形の頂点の数の上限
+  DynamicBatch(GLsizei threshold = 256)
+    : vbo(0), capacity(0), ibo(0), ibocount(0), threshold(threshold)
+  {
+    // 頂点配列オブジェクト
+    glGenVertexArrays(1, &vao);
+
+    // 毎フレーム書き換える頂点バッファオブジェクト
+    resize(2048);
+  }
+
+  // デストラクタ
+  ~DynamicBatch()
+  {
+    // GPU が使い終わってから削除する
+    ReleaseQueue &queue(ReleaseQueue::get());
+    queue.deleteVertexArray(vao);
+    queue.deleteBuffer(vbo, capacity * stride, GL_STREAM_DRAW);
+    queue.deleteBuffer(ibo, ibocount * sizeof (GLuint), GL_STATIC_DRAW);
+  }
+
+  // まとめて描く図形を登録する
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  //   戻り値: 登録した図形の番号
+  unsigned int add(GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+  {
+    // 溶接してから登録する
+    const Weld weld(vertexcount, vertex, indexcount, index, 3);
+    const Mesh m =
+    {
+      static_cast<GLuint>(this->vertex.size()), weld.getVertexCount(),
+      static_cast<GLuint>(this->index.size()), weld.getIndexCount()
+    };
+    this->vertex.insert(this->vertex.end(), weld.getVertex(),
+      weld.getVertex() + weld.getVertexCount());
+    this->index.insert(this->index.end(), weld.getIndex(),
+      weld.getIndex() + weld.getIndexCount());
+    mesh.emplace_back(m);
+
+    return static_cast<unsigned int>(mesh.size() - 1);
+  }
+
+  // まとめて描く図形の頂点の数の上限を取り出す
+  GLsizei getThreshold() const
+  {
+    return threshold;
+  }
+
+  // まとめて描く図形の頂点の数の上限を設定する
+  //   threshold: まとめて描く図形の頂点の数の上限
+  void setThreshold(GLsizei threshold)
+  {
+    this->threshold = threshold;
+  }
+
+  // 描画命令一つと頂点一つの変換の CPU 時間を測ってまとめて描く図形の頂点の数の上限を決める
+  //   setup: 個別に描くときに描画命令ごとに変換行列を設定する関数
+  //   (使用中のプログラムオブジェクトで登録済みの図形を実際には描かずに描画命令を出す)
+  //   戻り値: 決めた上限
+  template <typename Setup>
+  GLsizei calibrate(Setup setup)
+  {
+    typedef std::chrono::steady_clock clock;
+    if (mesh.empty()) return threshold;
+    if (ibocount != static_cast<GLsizei>(index.size())) upload();
+
+    // 頂点一つを変換する時間を測る
+    static constexpr GLsizei samples(4096), repeat(16);
+    std::vector<Object::Vertex> src(samples), dst(samples);
+    for (GLsizei i = 0; i < samples; ++i) src[i] = vertex[i % vertex.size()];
+    const Matrix model(Matrix::rotate(0.5f, 0.0f, 1.0f, 0.0f));
+    const clock::time_point t0(clock::now());
+    for (GLsizei r = 0; r < repeat; ++r) transform(model, src.data(), samples, dst.data());
+    const clock::time_point t1(clock::now());
+    const double vertexcost(std::chrono::duration<double>(t1 - t0).count() / (samples * repeat));
+
+    // 描画命令一つを出す時間を測る (ラスタライザは止めておく)
+    static constexpr int draws(256);
+    glFinish();
+    State::get().enable(GL_RASTERIZER_DISCARD);
+    State::get().bindVertexArray(vao);
+    const clock::time_point t2(clock::now());
+    for (int i = 0; i < draws; ++i)
+    {
+      setup(model);
+      glDrawElementsBaseVertex(GL_TRIANGLES, mesh[0].indexcount, GL_UNSIGNED_INT,
+        static_cast<GLuint *>(0) + mesh[0].indexfirst, 0);
+    }
+    const clock::time_point t3(clock::now());
+    State::get().disable(GL_RASTERIZER_DISCARD);
+    glFinish();
+    const double drawcost(std::chrono::duration<double>(t3 - t2).count() / draws);
+
+    // 描画命令一つの時間で変換できる頂点の数を上限にする
+    const double n(vertexcost > 0.0 ? drawcost / vertexcost : 65536.0);
+    threshold = static_cast<GLsizei>(std::min(std::max(n, 16.0), 65536.0));
+    return threshold;
+  }
+
+  // このフレームに描く図形を空にする
+  void clear()
+  {
+    instance.clear();
+  }
+
+  // このフレームに描く図形を追加する
+  //   m: 登録した図形の番号
+  //   model: モデル変換行列
+  //   material: 材質の番号
+  //   戻り値: まとめて描くなら true, 頂点が多すぎて個別に描くべきなら false
+  bool submit(unsigned int m, const Matrix &model, unsigned int material)
+  {
+    if (mesh[m].vertexcount > threshold) return false;
+    const Instance i = { m, model, material };
+    instance.emplace_back(i);
+    return true;
+  }
+
+  // 追加した図形を変換して頂点バッファオブジェクトに格納する
+  void update()
+  {
+    count.clear();
+    first.clear();
+    basevertex.clear();
+    if (instance.empty()) return;
+
+    // 新しく登録された図形があれば頂点のインデックスを転送し直す
+    if (ibocount != static_cast<GLsizei>(index.size())) upload();
+
+    // 頂点バッファオブジェクトが足りなければ倍々に大きくする
+    GLsizei total(0);
+    for (const Instance &i : instance) total += mesh[i.mesh].vertexcount;
+    if (total > capacity)
+    {
+      GLsizei n(capacity);
+      while (n < total) n *= 2;
+      resize(n);
+    }
+
+    // 前のフレームの内容は捨てて書き込む
+    State::get().bindBuffer(GL_ARRAY_BUFFER, vbo);
+    char *const buffer(static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER,
+      0, capacity * stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)));
+    if (buffer == NULL) return;
+    Object::Vertex *const dst(reinterpret_cast<Object::Vertex *>(buffer));
+    GLint *const id(reinterpret_cast<GLint *>(buffer + capacity * sizeof (Object::Vertex)));
+
+    // 追加した順に変換して頂点ごとに材質の番号を書き込み一つの描画命令にまとめる
+    GLint base(0);
+    for (const Instance &i : instance)
+    {
+      const Mesh &m(mesh[i.mesh]);
+      transform(i.model, vertex.data() + m.vertexfirst, m.vertexcount, dst + base);
+      std::fill(id + base, id + base + m.vertexcount, static_cast<GLint>(i.material));
+
+      count.emplace_back(m.indexcount);
+      first.emplace_back(static_cast<GLuint *>(0) + m.indexfirst);
+      basevertex.emplace_back(base);
+      base += m.vertexcount;
+    }
+
+    // 書き込みの途中で内容が失われていたらこのフレームは描かない
+    if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+    {
+      count.clear();
+      first.clear();
+      basevertex.clear();
+      return;
+    }
+
+    Stats &s(stats());
+    s.instances += instance.size();
+    ++s.drawCalls;
+    s.vertices += total;
+  }
+
+  // まとめた図形を描画する (頂点はワールド座標系にあり材質の番号は頂点ごとに加える)
+  void draw() const
+  {
+    if (count.empty()) return;
+
+    State::get().bindVertexArray(vao);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, const_cast<GLsizei *>(count.data()),
+      GL_UNSIGNED_INT, const_cast<GLvoid **>(first.data()),
+      static_cast<GLsizei>(count.size()), const_cast<GLint *>(basevertex.data()));
+  }
+};
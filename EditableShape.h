@@ -0,0 +1,269 @@
+﻿#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <GL/glew.h>
+
+// 図形データ
+#include "Object.h"
+
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
+// 書き換えた範囲
+#include "DirtyRange.h"
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// 頂点属性やインデックスを部分的に書き換えられる三角形による描画
+//
+class EditableShape
+{
+  // 頂点属性の CPU 側の写し
+  std::vector<Object::Vertex> vertex;
+
+  // 頂点のインデックスの CPU 側の写し
+  std::vector<GLuint> index;
+
+  // 書き換えた頂点属性とインデックスの範囲
+  DirtyRange vertexdirty, indexdirty;
+
+  // 頂点の位置の次元
+  const GLint size;
+
+  // 頂点配列オブジェクト名
+  GLuint vao;
+
+  // 頂点バッファオブジェクト名と確保した頂点の数
+  GLuint vbo;
+  GLsizei vertexcapacity;
+
+  // インデックスの頂点バッファオブジェクト名と確保した要素数
+  GLuint ibo;
+  GLsizei indexcapacity;
+
+  // 転送済みの頂点の数
+  GLsizei vertexcount;
+
+  // 描画に使う頂点のインデックスの要素数
+  GLsizei indexcount;
+
+  // コピーコンストラクタによるコピー禁止
+  EditableShape(const EditableShape &s);
+
+  // 代入によるコピー禁止
+  EditableShape &operator=(const EditableShape &s);
+
+  // バッファオブジェクトを大きくする
+  //   buffer: バッファオブジェクト名
+  //   capacity: 確保した要素数
+  //   count: 必要な要素数
+  //   used: 転送済みの要素数
+  //   element: 一要素のサイズ
+  //   戻り値: 作り直したら true
+  static bool grow(GLuint &buffer, GLsizei &capacity, GLsizei count, GLsizei used,
+    GLsizeiptr element)
+  {
+    if (count <= capacity) return false;
+
+    // 倍々に大きくする
+    GLsizei c(std::max(capacity, 64));
+    while (c < count) c *= 2;
+
+    // 転送済みの内容は GPU 上で新しいバッファオブジェクトに複写する
+    ReleaseQueue &queue(ReleaseQueue::get());
+    const GLuint b(queue.createBuffer(GL_COPY_WRITE_BUFFER, c * element, NULL, GL_DYNAMIC_DRAW));
+    if (used > 0)
+    {
+      State::get().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used * element);
+    }
+    queue.deleteBuffer(buffer, capacity * element, GL_DYNAMIC_DRAW);
+    buffer = b;
+    capacity = c;
+    ++stats().grows;
+
+    return true;
+  }
+
+  // 書き換えた範囲を転送する
+  //   target: バッファオブジェクトの結合ターゲット
+  //   buffer: バッファオブジェクト名
+  //   dirty: 書き換えた範囲
+  //   data: CPU 側の写し
+  //   element: 一要素のサイズ
+  static void upload(GLenum target, GLuint buffer, DirtyRange &dirty, const void *data,
+    GLsizeiptr element)
+  {
+    // 小さな隙間は転送し直した方が命令の数が減るのでまとめる
+    const GLsizei gap(static_cast<GLsizei>(256 / element));
+
+    State::get().bindBuffer(target, buffer);
+    for (const auto &r : dirty.coalesce(gap))
+    {
+      const GLsizeiptr bytes((r.second - r.first) * element);
+      glBufferSubData(target, r.first * element, bytes,
+        static_cast<const char *>(data) + r.first * element);
+      ++stats().uploads;
+      stats().bytes += bytes;
+    }
+    dirty.clear();
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // バッファオブジェクトへの転送の回数
+    unsigned long long uploads;
+
+    // 転送したバイト数
+    unsigned long long bytes;
+
+    // バッファオブジェクトを大きくした回数
+    unsigned long long grows;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ (頂点の番号を保つために溶接はしない)
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  EditableShape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+    : vertex(vertex, vertex + vertexcount), index(index, index + indexcount)
+    , size(size), vbo(0), vertexcapacity(0), ibo(0), indexcapacity(0)
+    , vertexcount(0), indexcount(0)
+  {
+    // 頂点配列オブジェクト
+    glGenVertexArrays(1, &vao);
+
+    // 全体を書き換えたことにして最初の転送で送る
+    vertexdirty.mark(0, vertexcount);
+    indexdirty.mark(0, indexcount);
+    update();
+  }
+
+  // デストラクタ
+  ~EditableShape()
+  {
+    // GPU が使い終わってから削除する
+    ReleaseQueue &queue(ReleaseQueue::get());
+    queue.deleteVertexArray(vao);
+    queue.deleteBuffer(vbo, vertexcapacity * sizeof (Object::Vertex), GL_DYNAMIC_DRAW);
+    queue.deleteBuffer(ibo, indexcapacity * sizeof (GLuint), GL_DYNAMIC_DRAW);
+  }
+
+  // 頂点の数を取り出す
+  GLsizei getVertexCount() const
+  {
+    return static_cast<GLsizei>(vertex.size());
+  }
+
+  // 頂点のインデックスの要素数を取り出す
+  GLsizei getIndexCount() const
+  {
+    return static_cast<GLsizei>(index.size());
+  }
+
+  // 頂点属性を取り出す
+  //   i: 頂点の番号
+  const Object::Vertex &getVertex(GLsizei i) const
+  {
+    return vertex[i];
+  }
+
+  // 頂点属性を書き換える
+  //   first: 書き換える先頭の頂点の番号
+  //   count: 書き換える頂点の数
+  //   data: 頂点属性を格納した配列
+  void setVertex(GLsizei first, GLsizei count, const Object::Vertex *data)
+  {
+    std::copy(data, data + count, vertex.begin() + first);
+    vertexdirty.mark(first, count);
+  }
+
+  // 頂点を追加する
+  //   count: 追加する頂点の数
+  //   data: 頂点属性を格納した配列
+  //   戻り値: 追加した先頭の頂点の番号
+  GLsizei addVertex(GLsizei count, const Object::Vertex *data)
+  {
+    const GLsizei first(getVertexCount());
+    vertex.insert(vertex.end(), data, data + count);
+    vertexdirty.mark(first, count);
+    return first;
+  }
+
+  // 頂点のインデックスを書き換える
+  //   first: 書き換える先頭の位置
+  //   count: 書き換える要素数
+  //   data: 頂点のインデックスを格納した配列
+  void setIndex(GLsizei first, GLsizei count, const GLuint *data)
+  {
+    std::copy(data, data + count, index.begin() + first);
+    indexdirty.mark(first, count);
+  }
+
+  // 頂点のインデックスを追加する
+  //   count: 追加する要素数
+  //   data: 頂点のインデックスを格納した配列
+  //   戻り値: 追加した先頭の位置
+  GLsizei addIndex(GLsizei count, const GLuint *data)
+  {
+    const GLsizei first(getIndexCount());
+    index.insert(index.end(), data, data + count);
+    indexdirty.mark(first, count);
+    return first;
+  }
+
+  // 書き換えた部分だけを GPU に転送する (描画の前に呼び出す)
+  void update()
+  {
+    State::get().bindVertexArray(vao);
+
+    // 頂点が増えて入りきらなければ頂点バッファオブジェクトを大きくする
+    if (grow(vbo, vertexcapacity, getVertexCount(), vertexcount, sizeof (Object::Vertex)))
+    {
+      // 大きくした頂点バッファオブジェクトを in 変数から参照できるようにする
+      State::get().bindBuffer(GL_ARRAY_BUFFER, vbo);
+      glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, sizeof (Object::Vertex),
+        static_cast<char *>(0));
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof (Object::Vertex),
+        static_cast<char *>(0) + sizeof (GLfloat) * 3);
+      glEnableVertexAttribArray(1);
+    }
+
+    // インデックスが増えて入りきらなければ大きくする
+    if (grow(ibo, indexcapacity, getIndexCount(), indexcount, sizeof (GLuint)))
+      State::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+    // 書き換えた範囲を転送する
+    upload(GL_ARRAY_BUFFER, vbo, vertexdirty, vertex.data(), sizeof (Object::Vertex));
+    upload(GL_ELEMENT_ARRAY_BUFFER, ibo, indexdirty, index.data(), sizeof (GLuint));
+    vertexcount = getVertexCount();
+    indexcount = getIndexCount();
+  }
+
+  // 描画
+  void draw() const
+  {
+    // 頂点配列オブジェクトを結合する
+    State::get().bindVertexArray(vao);
+
+    // 三角形で描画する
+    glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+  }
+};
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <cmath>
+#include <GL/glew.h>
+
+// 変換行列
+#include "Matrix.h"
+
+//
+// 視錐台
+//
+class Frustum
+{
+  // 視錐台の六つの面の平面方程式
+  GLfloat plane[6][4];
+
+public:
+
+  // コンストラクタ
+  //   m: 投影変換行列とモデルビュー変換行列の積
+  Frustum(const Matrix &m)
+  {
+    for (int i = 0; i < 6; ++i)
+    {
+      // 左右・下上・前後の面は 4 行目に 1～3 行目を加減したもの
+      const int j(i >> 1);
+      const GLfloat s(i & 1 ? -1.0f : 1.0f);
+      GLfloat *const p(plane[i]);
+
+      for (int k = 0; k < 4; ++k)
+        p[k] = m[k * 4 + 3] + s * m[k * 4 + j];
+
+      // 平面の法線ベクトルを正規化して距離を求められるようにする
+      const GLfloat l(sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]));
+      if (l > 0.0f) for (int k = 0; k < 4; ++k) p[k] /= l;
+    }
+  }
+
+  // 球が視錐台の外にあれば false を返す
+  //   c: 球の中心
+  //   r: 球の半径
+  bool sphere(const GLfloat *c, GLfloat r) const
+  {
+    for (int i = 0; i < 6; ++i)
+    {
+      const GLfloat *const p(plane[i]);
+      if (p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] < -r) return false;
+    }
+
+    return true;
+  }
+};
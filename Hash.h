@@ -0,0 +1,107 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+//
+// xxHash64 と同じ手順による高速なハッシュ関数
+//
+class Hash
+{
+  // 素数
+  static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+  static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+  static constexpr std::uint64_t prime3 = 0x165667B19E3779F9ull;
+  static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+  static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+  // 左回転
+  static std::uint64_t rotl(std::uint64_t x, int r)
+  {
+    return x << r | x >> (64 - r);
+  }
+
+  // 8 バイトを読み出す
+  static std::uint64_t read64(const unsigned char *p)
+  {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+  }
+
+  // 4 バイトを読み出す
+  static std::uint32_t read32(const unsigned char *p)
+  {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+  }
+
+  // 1 レーン分の更新
+  static std::uint64_t round(std::uint64_t acc, std::uint64_t input)
+  {
+    return rotl(acc + input * prime2, 31) * prime1;
+  }
+
+  // レーンの値の合成
+  static std::uint64_t merge(std::uint64_t acc, std::uint64_t val)
+  {
+    return (acc ^ round(0, val)) * prime1 + prime4;
+  }
+
+public:
+
+  // バイト列のハッシュ値を求める
+  //   data: バイト列
+  //   length: バイト列の長さ
+  //   seed: ハッシュ値の種 (別のバイト列のハッシュ値を与えると連結できる)
+  static std::uint64_t compute(const void *data, std::size_t length, std::uint64_t seed = 0)
+  {
+    const unsigned char *p(static_cast<const unsigned char *>(data));
+    const unsigned char *const end(p + length);
+    std::uint64_t h;
+
+    if (length >= 32)
+    {
+      // 32 バイトずつ四つのレーンで処理する
+      std::uint64_t v1(seed + prime1 + prime2), v2(seed + prime2), v3(seed), v4(seed - prime1);
+      do
+      {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+      }
+      while (p + 32 <= end);
+
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = merge(h, v1);
+      h = merge(h, v2);
+      h = merge(h, v3);
+      h = merge(h, v4);
+    }
+    else
+      h = seed + prime5;
+
+    h += length;
+
+    // 残りのバイトを処理する
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+    if (p + 4 <= end)
+    {
+      h = rotl(h ^ read32(p) * prime1, 23) * prime2 + prime3;
+      p += 4;
+    }
+    for (; p < end; ++p) h = rotl(h ^ *p * prime5, 11) * prime1;
+
+    // 攪拌する
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+
+    return h;
+  }
+};
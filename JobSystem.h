@@ -0,0 +1,404 @@
+﻿#pragma once
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+//
+// 仕事を盗み合うスレッドプール
+//
+// ワーカースレッドはそれぞれ自分の両端キューを持ち、自分で積んだ仕事は後ろから
+// 取り出し、手が空いたら他のキューの前から盗む。仕事の完了を待つスレッドも
+// 待っている間は他の仕事を処理する。OpenGL を呼び出す仕事はメインスレッド専用の
+// キューに積み、メインスレッドが drain() か wait() で処理する
+//
+class JobSystem
+{
+public:
+
+  // 仕事
+  class Job
+  {
+    friend class JobSystem;
+
+    // 処理する関数
+    std::function<void()> func;
+
+    // 終わっていない先行する仕事の数 (投入するまでは 1 多い)
+    std::atomic<int> pending;
+
+    // 終わっていれば true
+    std::atomic<bool> done;
+
+    // 後続の仕事の登録の排他制御
+    std::mutex mutex;
+
+    // この仕事が終わったら投入する後続の仕事
+    std::vector<std::shared_ptr<Job>> next;
+
+    // メインスレッドで処理するなら true
+    const bool main;
+
+  public:
+
+    // コンストラクタ
+    //   func: 処理する関数
+    //   main: メインスレッドで処理するなら true
+    Job(std::function<void()> func, bool main)
+      : func(std::move(func)), pending(1), done(false), main(main)
+    {
+    }
+
+    // 終わっていれば true
+    bool finished() const
+    {
+      return done;
+    }
+  };
+
+  // 仕事のハンドル
+  typedef std::shared_ptr<Job> Handle;
+
+  // 統計
+  struct Stats
+  {
+    // 処理した仕事の数
+    std::atomic<unsigned long long> executed;
+
+    // 他のキューから盗んだ仕事の数
+    std::atomic<unsigned long long> stolen;
+
+    // メインスレッド専用のキューで処理した仕事の数
+    std::atomic<unsigned long long> main;
+  };
+
+private:
+
+  // スレッドごとの仕事の両端キュー
+  struct Queue
+  {
+    // 排他制御
+    std::mutex mutex;
+
+    // 仕事
+    std::deque<Handle> job;
+  };
+
+  // ワーカースレッドごとのキューと最後のワーカースレッド以外から積んだ仕事のキュー
+  std::vector<std::unique_ptr<Queue>> queue;
+
+  // メインスレッド専用のキュー
+  Queue mainQueue;
+
+  // メインスレッド
+  const std::thread::id mainThread;
+
+  // ワーカースレッド
+  std::vector<std::thread> worker;
+
+  // キューに積まれている仕事の数
+  std::atomic<int> queued;
+
+  // 終了するなら true
+  std::atomic<bool> quit;
+
+  // 仕事がないときに眠るための排他制御と条件変数
+  std::mutex sleep;
+  std::condition_variable wake;
+
+  // コピーコンストラクタによるコピー禁止
+  JobSystem(const JobSystem &j);
+
+  // 代入によるコピー禁止
+  JobSystem &operator=(const JobSystem &j);
+
+  // このスレッドが受け持つキューの番号 (ワーカースレッドでなければ -1)
+  static int &self()
+  {
+    static thread_local int index(-1);
+    return index;
+  }
+
+  // このスレッドが属するスレッドプール
+  static JobSystem *&owner()
+  {
+    static thread_local JobSystem *pool(nullptr);
+    return pool;
+  }
+
+  // このスレッドが積むキューの番号を求める
+  std::size_t home() const
+  {
+    return owner() == this ? self() : queue.size() - 1;
+  }
+
+  // 先行する仕事が全て終わった仕事をキューに積む
+  //   job: 仕事
+  void enqueue(const Handle &job)
+  {
+    if (job->main)
+    {
+      std::lock_guard<std::mutex> lock(mainQueue.mutex);
+      mainQueue.job.emplace_back(job);
+      return;
+    }
+
+    Queue &q(*queue[home()]);
+    {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.job.emplace_back(job);
+    }
+
+    // 眠っているワーカースレッドを一つ起こす
+    {
+      std::lock_guard<std::mutex> lock(sleep);
+      ++queued;
+    }
+    wake.notify_one();
+  }
+
+  // 先行する仕事が一つ終わったことを知らせる
+  //   job: 仕事
+  void release(const Handle &job)
+  {
+    if (--job->pending == 0) enqueue(job);
+  }
+
+  // 仕事を処理して後続の仕事を投入する
+  //   job: 仕事
+  void execute(const Handle &job)
+  {
+    job->func();
+    ++stats().executed;
+
+    std::vector<Handle> next;
+    {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->done = true;
+      next.swap(job->next);
+    }
+    for (const Handle &n : next) release(n);
+  }
+
+  // キューから仕事を一つ取り出して処理する
+  //   戻り値: 処理する仕事がなければ false
+  bool runOne()
+  {
+    const std::size_t n(queue.size()), h(home());
+    Handle job;
+
+    // 自分のキューの後ろから取り出す
+    {
+      Queue &q(*queue[h]);
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.job.empty())
+      {
+        job = std::move(q.job.back());
+        q.job.pop_back();
+      }
+    }
+
+    // なければ他のキューの前から盗む
+    for (std::size_t i = 1; !job && i < n; ++i)
+    {
+      Queue &q(*queue[(h + i) % n]);
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.job.empty())
+      {
+        job = std::move(q.job.front());
+        q.job.pop_front();
+        ++stats().stolen;
+      }
+    }
+
+    if (!job) return false;
+    --queued;
+    execute(job);
+    return true;
+  }
+
+  // メインスレッド専用のキューから仕事を一つ取り出して処理する
+  //   戻り値: 処理する仕事がなければ false
+  bool runMain()
+  {
+    Handle job;
+    {
+      std::lock_guard<std::mutex> lock(mainQueue.mutex);
+      if (mainQueue.job.empty()) return false;
+      job = std::move(mainQueue.job.front());
+      mainQueue.job.pop_front();
+    }
+
+    execute(job);
+    ++stats().main;
+    return true;
+  }
+
+  // ワーカースレッドの処理
+  //   index: 受け持つキューの番号
+  void work(int index)
+  {
+    self() = index;
+    owner() = this;
+
+    while (!quit)
+    {
+      if (runOne()) continue;
+
+      // 仕事が積まれるまで眠る
+      std::unique_lock<std::mutex> lock(sleep);
+      wake.wait(lock, [this]() { return queued > 0 || quit; });
+    }
+  }
+
+public:
+
+  // コンストラクタ
+  //   threads: 呼び出したスレッドを含めて使うスレッドの数 (0 ならハードウェアスレッドの数)
+  JobSystem(unsigned int threads = 0)
+    : mainThread(std::this_thread::get_id()), queued(0), quit(false)
+  {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // ワーカースレッドのキューと外から積むキュー
+    for (unsigned int i = 0; i < threads; ++i) queue.emplace_back(new Queue);
+
+    // 呼び出したスレッドも仕事を処理するのでワーカースレッドは一つ少なくする
+    for (unsigned int i = 0; i < threads - 1; ++i)
+      worker.emplace_back(&JobSystem::work, this, static_cast<int>(i));
+  }
+
+  // デストラクタ
+  ~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleep);
+      quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : worker) t.join();
+  }
+
+  // 全体で使うスレッドプールを取り出す (終了時の破棄の順序に左右されないように解放しない)
+  static JobSystem &get()
+  {
+    static JobSystem *const instance(new JobSystem);
+    return *instance;
+  }
+
+  // 呼び出したスレッドを含めて使うスレッドの数を取り出す
+  unsigned int getThreadCount() const
+  {
+    return static_cast<unsigned int>(worker.size() + 1);
+  }
+
+  // 仕事を作る (submit() するまで処理しない)
+  //   func: 処理する関数
+  //   main: メインスレッドで処理するなら true
+  static Handle create(std::function<void()> func, bool main = false)
+  {
+    return std::make_shared<Job>(std::move(func), main);
+  }
+
+  // 先行する仕事が終わるまで仕事を始めないようにする (submit() の前に呼び出す)
+  //   job: 仕事
+  //   before: 先行する仕事
+  static void depend(const Handle &job, const Handle &before)
+  {
+    std::lock_guard<std::mutex> lock(before->mutex);
+    if (before->done) return;
+    ++job->pending;
+    before->next.emplace_back(job);
+  }
+
+  // 仕事を投入する (先行する仕事が全て終わるとキューに積まれる)
+  //   job: 仕事
+  void submit(const Handle &job)
+  {
+    release(job);
+  }
+
+  // 仕事を作って投入する
+  //   func: 処理する関数
+  //   main: メインスレッドで処理するなら true
+  Handle run(std::function<void()> func, bool main = false)
+  {
+    const Handle job(create(std::move(func), main));
+    submit(job);
+    return job;
+  }
+
+  // 先行する仕事が終わったら処理する仕事を作って投入する
+  //   before: 先行する仕事
+  //   func: 処理する関数
+  //   main: メインスレッドで処理するなら true
+  Handle then(const Handle &before, std::function<void()> func, bool main = false)
+  {
+    const Handle job(create(std::move(func), main));
+    depend(job, before);
+    submit(job);
+    return job;
+  }
+
+  // 仕事が終わるまで他の仕事を処理しながら待つ
+  //   job: 仕事
+  void wait(const Handle &job)
+  {
+    const bool isMain(std::this_thread::get_id() == mainThread);
+    while (!job->done)
+    {
+      if (isMain && runMain()) continue;
+      if (!runOne()) std::this_thread::yield();
+    }
+  }
+
+  // メインスレッド専用のキューに積まれた仕事を全て処理する (メインスレッドで呼び出す)
+  void drain()
+  {
+    while (runMain());
+  }
+
+  // 添字の範囲を分割して並列に処理する
+  //   begin: 範囲の先頭
+  //   end: 範囲の末尾の次
+  //   func: 添字の部分範囲 [b, e) を処理する関数
+  template <typename Func>
+  void parallelFor(int begin, int end, Func func)
+  {
+    const int count(end - begin);
+    if (count <= 0) return;
+
+    // 盗み合って負荷を均せるようにスレッドの数より細かく分ける
+    const int chunks(std::min(count, static_cast<int>(getThreadCount()) * 4));
+    if (chunks == 1)
+    {
+      func(begin, end);
+      return;
+    }
+
+    // 最初の部分以外を仕事として投入して最初の部分は呼び出したスレッドで処理する
+    std::vector<Handle> job;
+    job.reserve(chunks - 1);
+    for (int i = 1; i < chunks; ++i)
+    {
+      const int b(begin + count * i / chunks), e(begin + count * (i + 1) / chunks);
+      job.emplace_back(run([&func, b, e]() { func(b, e); }));
+    }
+    func(begin, begin + count / chunks);
+
+    // 全ての部分が終わるのを待つ
+    for (const Handle &j : job) wait(j);
+  }
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
@@ -0,0 +1,213 @@
+﻿#pragma once
+#include <cstddef>
+#include <iostream>
+#include <GL/glew.h>
+
+//
+// uniform ブロックのメンバの型
+//
+namespace glsl
+{
+  // float / int / uint / bool
+  struct Scalar {};
+
+  // vecN / ivecN / uvecN
+  template <int N> struct Vec {};
+
+  // matCxR (列優先)
+  template <int C, int R = C> struct Mat {};
+
+  // 配列
+  template <typename T, std::size_t N> struct Array {};
+}
+
+//
+// メンバの配置の規則
+//
+enum class Packing
+{
+  Std140,                 // uniform ブロックの標準の配置
+  Std430                  // shader storage ブロックの詰めた配置
+};
+
+// 値を境界にそろえる
+//   x: 値
+//   a: 境界
+constexpr std::size_t alignUp(std::size_t x, std::size_t a)
+{
+  return (x + a - 1) / a * a;
+}
+
+// 型ごとの境界とサイズ
+template <Packing P, typename T> struct LayoutRule;
+
+// スカラは 4 バイト
+template <Packing P> struct LayoutRule<P, glsl::Scalar>
+{
+  static constexpr std::size_t align() { return 4; }
+  static constexpr std::size_t size() { return 4; }
+};
+
+// vec2 は 8 バイト, vec3 と vec4 は 16 バイトの境界
+template <Packing P, int N> struct LayoutRule<P, glsl::Vec<N>>
+{
+  static_assert(N >= 2 && N <= 4, "vector must have 2 to 4 components");
+  static constexpr std::size_t align() { return N == 2 ? 8 : 16; }
+  static constexpr std::size_t size() { return N * 4; }
+};
+
+// 配列は要素の間隔 (std140 では 16 バイトの倍数) に要素数をかける
+template <Packing P, typename T, std::size_t N> struct LayoutRule<P, glsl::Array<T, N>>
+{
+  static constexpr std::size_t align()
+  {
+    return P == Packing::Std140 ? alignUp(LayoutRule<P, T>::align(), 16) : LayoutRule<P, T>::align();
+  }
+  static constexpr std::size_t stride() { return alignUp(LayoutRule<P, T>::size(), align()); }
+  static constexpr std::size_t size() { return stride() * N; }
+};
+
+// 行列は列ベクトルの配列
+template <Packing P, int C, int R> struct LayoutRule<P, glsl::Mat<C, R>>
+  : LayoutRule<P, glsl::Array<glsl::Vec<R>, C>>
+{
+};
+
+// メンバの型の並びから i 番目のメンバの境界とサイズを取り出す
+template <Packing P, typename... M> struct LayoutMembers;
+
+template <Packing P> struct LayoutMembers<P>
+{
+  static constexpr std::size_t align(std::size_t) { return 1; }
+  static constexpr std::size_t size(std::size_t) { return 0; }
+};
+
+template <Packing P, typename H, typename... T> struct LayoutMembers<P, H, T...>
+{
+  static constexpr std::size_t align(std::size_t i)
+  {
+    return i == 0 ? LayoutRule<P, H>::align() : LayoutMembers<P, T...>::align(i - 1);
+  }
+  static constexpr std::size_t size(std::size_t i)
+  {
+    return i == 0 ? LayoutRule<P, H>::size() : LayoutMembers<P, T...>::size(i - 1);
+  }
+};
+
+//
+// uniform ブロックの配置
+//   P: 配置の規則
+//   M: 宣言順のメンバの型
+//
+template <Packing P, typename... M>
+struct Layout
+{
+  // メンバの境界とサイズ
+  typedef LayoutMembers<P, M...> Members;
+
+  // メンバの数
+  static constexpr std::size_t count() { return sizeof...(M); }
+
+  // i 番目のメンバの境界
+  static constexpr std::size_t align(std::size_t i) { return Members::align(i); }
+
+  // i 番目のメンバのサイズ
+  static constexpr std::size_t size(std::size_t i) { return Members::size(i); }
+
+  // i 番目のメンバの位置
+  static constexpr std::size_t offset(std::size_t i)
+  {
+    return i == 0 ? 0 : alignUp(offset(i - 1) + size(i - 1), align(i));
+  }
+
+  // ブロック全体の境界 (std140 では 16 バイトの倍数に切り上げる)
+  static constexpr std::size_t base(std::size_t i = 0)
+  {
+    return i == count() ? (P == Packing::Std140 ? 16 : 1)
+      : (align(i) > base(i + 1) ? align(i) : base(i + 1));
+  }
+
+  // ブロック全体のサイズ
+  static constexpr std::size_t bytes()
+  {
+    return count() == 0 ? 0 : alignUp(offset(count() - 1) + size(count() - 1), base());
+  }
+
+  // メンバのサイズの合計
+  static constexpr std::size_t used(std::size_t i = 0)
+  {
+    return i == count() ? 0 : size(i) + used(i + 1);
+  }
+
+  // 詰め物のバイト数
+  static constexpr std::size_t padding()
+  {
+    return bytes() - used();
+  }
+
+  // 境界の大きい順 (同じなら宣言順) に並べたときの i 番目のメンバの順位
+  static constexpr std::size_t rank(std::size_t i, std::size_t j = 0)
+  {
+    return j == count() ? 0
+      : (align(j) > align(i) || (align(j) == align(i) && j < i) ? 1 : 0) + rank(i, j + 1);
+  }
+
+  // 境界の大きい順に並べたときの p 番目のメンバの宣言順の番号
+  static constexpr std::size_t member(std::size_t p, std::size_t i = 0)
+  {
+    return i == count() || rank(i) == p ? i : member(p, i + 1);
+  }
+
+  // 境界の大きい順に並べたときの p 番目のメンバの位置
+  static constexpr std::size_t packedOffset(std::size_t p)
+  {
+    return p == 0 ? 0
+      : alignUp(packedOffset(p - 1) + size(member(p - 1)), align(member(p)));
+  }
+
+  // 境界の大きい順に並べたときのブロック全体のサイズ
+  static constexpr std::size_t packedBytes()
+  {
+    return count() == 0 ? 0
+      : alignUp(packedOffset(count() - 1) + size(member(count() - 1)), base());
+  }
+
+  // プログラムオブジェクトが実際に使う配置と一致するか調べる
+  //   program: プログラムオブジェクト名
+  //   block: uniform ブロック名
+  //   names: 宣言順のメンバ名
+  //   戻り値: 一致していれば true
+  static bool verify(GLuint program, const char *block, const char *const *names)
+  {
+    // uniform ブロックのサイズを調べる
+    const GLuint index(glGetUniformBlockIndex(program, block));
+    if (index == GL_INVALID_INDEX)
+    {
+      std::cerr << "Error: No uniform block: " << block << std::endl;
+      return false;
+    }
+    GLint data;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &data);
+    bool status(static_cast<std::size_t>(data) >= offset(count() - 1) + size(count() - 1));
+    if (!status) std::cerr << "Error: " << block << " is " << data << " bytes" << std::endl;
+
+    // メンバの位置を調べる
+    for (std::size_t i = 0; i < count(); ++i)
+    {
+      GLuint u;
+      glGetUniformIndices(program, 1, names + i, &u);
+      if (u == GL_INVALID_INDEX) continue;
+
+      GLint o;
+      glGetActiveUniformsiv(program, 1, &u, GL_UNIFORM_OFFSET, &o);
+      if (static_cast<std::size_t>(o) != offset(i))
+      {
+        std::cerr << "Error: " << block << "." << names[i] << " is at " << o
+          << " but expected at " << offset(i) << std::endl;
+        status = false;
+      }
+    }
+
+    return status;
+  }
+};
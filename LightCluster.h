@@ -0,0 +1,307 @@
+﻿#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+
+// 変換行列
+#include "Matrix.h"
+
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
+// 並列処理
+#include "Parallel.h"
+
+//
+// 視錐台を分割したクラスタごとに影響する光源を求める
+//
+class LightCluster
+{
+public:
+
+  // 光源
+  struct Light
+  {
+    // ワールド座標系における位置
+    GLfloat position[3];
+
+    // 影響の及ぶ半径
+    GLfloat radius;
+
+    // 環境光強度
+    GLfloat ambient[3];
+
+    // 拡散反射光強度
+    GLfloat diffuse[3];
+
+    // 鏡面反射光強度
+    GLfloat specular[3];
+  };
+
+private:
+
+  // 光源
+  std::vector<Light> light;
+
+  // 横, 縦, 奥行き方向のクラスタの数
+  const GLint count[3];
+
+  // クラスタごとの光源の番号の数の上限
+  GLuint limit;
+
+  // 視点座標系における光源の位置と半径, 環境光, 拡散反射光, 鏡面反射光強度
+  std::vector<GLfloat> data;
+
+  // クラスタごとの光源の番号の並びの先頭位置と数
+  std::vector<GLuint> grid;
+
+  // クラスタごとの光源の番号の並び
+  std::vector<GLuint> index;
+
+  // 光源, クラスタ, 光源の番号の並びのバッファオブジェクトとテクスチャ
+  GLuint buffer[3], texture[3];
+
+  // バッファオブジェクトの確保したサイズ
+  GLsizeiptr capacity[3];
+
+  // ビューポート
+  GLfloat viewport[4];
+
+  // 前方面の距離と奥行き方向の分割の係数
+  GLfloat depth[2];
+
+  // コピーコンストラクタによるコピー禁止
+  LightCluster(const LightCluster &c);
+
+  // 代入によるコピー禁止
+  LightCluster &operator=(const LightCluster &c);
+
+  // バッファオブジェクトにデータを転送する
+  //   i: バッファオブジェクトの番号
+  //   size: データのサイズ
+  //   data: データ
+  void upload(int i, GLsizeiptr size, const GLvoid *data)
+  {
+    // 足りなければ倍々に大きくする
+    while (capacity[i] < size) capacity[i] *= 2;
+
+    // GPU が使っている領域に書き込んで待たされないように新しい領域に取り替えてから書き込む
+    State::get().bindBuffer(GL_TEXTURE_BUFFER, buffer[i]);
+    glBufferData(GL_TEXTURE_BUFFER, capacity[i], NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // クラスタに割り当てた光源の延べ数
+    unsigned long long references;
+
+    // 処理したクラスタの延べ数
+    unsigned long long clusters;
+
+    // 上限を超えたのでクラスタに割り当てなかった光源の延べ数
+    unsigned long long dropped;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   x: 横方向のクラスタの数
+  //   y: 縦方向のクラスタの数
+  //   z: 奥行き方向のクラスタの数
+  LightCluster(GLint x = 16, GLint y = 9, GLint z = 24)
+    : count{ x, y, z }
+  {
+    // テクスチャバッファオブジェクト
+    static constexpr GLenum format[] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenTextures(3, texture);
+    for (int i = 0; i < 3; ++i)
+    {
+      capacity[i] = 1024;
+      buffer[i] = ReleaseQueue::get().createBuffer(GL_TEXTURE_BUFFER,
+        capacity[i], NULL, GL_STREAM_DRAW);
+      glBindTexture(GL_TEXTURE_BUFFER, texture[i]);
+      glTexBuffer(GL_TEXTURE_BUFFER, format[i], buffer[i]);
+    }
+
+    // 光源の番号の並びがテクスチャバッファの最大の大きさに収まるように
+    // クラスタごとの光源の番号の数を制限する
+    GLint texels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+    limit = static_cast<GLuint>(std::max(1, texels / (x * y * z)));
+  }
+
+  // デストラクタ
+  ~LightCluster()
+  {
+    glDeleteTextures(3, texture);
+    for (int i = 0; i < 3; ++i)
+      ReleaseQueue::get().deleteBuffer(buffer[i], capacity[i], GL_STREAM_DRAW);
+  }
+
+  // 光源を追加する
+  //   l: 光源
+  void add(const Light &l)
+  {
+    light.emplace_back(l);
+  }
+
+  // 光源の数を取り出す
+  std::size_t getLightCount() const
+  {
+    return light.size();
+  }
+
+  // クラスタごとに影響する光源を求めて転送する
+  //   projection: 透視投影変換行列
+  //   view: ビュー変換行列
+  //   port: ビューポートの原点と幅と高さ
+  void update(const Matrix &projection, const Matrix &view, const GLfloat *port)
+  {
+    // 前方面と後方面の距離
+    const GLfloat n(projection[14] / (projection[10] - 1.0f));
+    const GLfloat f(projection[14] / (projection[10] + 1.0f));
+    depth[0] = n;
+    depth[1] = 1.0f / log(f / n);
+
+    // ビューポート
+    std::copy(port, port + 4, viewport);
+
+    // 光源の位置を視点座標系に変換する
+    const std::size_t lights(light.size());
+    data.resize(std::max<std::size_t>(lights, 1) * 16);
+    for (std::size_t i = 0; i < lights; ++i)
+    {
+      const Light &l(light[i]);
+      GLfloat *const d(data.data() + i * 16);
+      for (int k = 0; k < 3; ++k)
+      {
+        d[k] = view[k] * l.position[0] + view[k + 4] * l.position[1]
+          + view[k + 8] * l.position[2] + view[k + 12];
+        d[k + 4] = l.ambient[k];
+        d[k + 8] = l.diffuse[k];
+        d[k + 12] = l.specular[k];
+      }
+      d[3] = l.radius;
+      d[7] = d[11] = d[15] = 0.0f;
+    }
+
+    // 奥行き方向のスライスごとに並列にクラスタと光源の交差を調べる
+    const GLint clusters(count[0] * count[1] * count[2]);
+    grid.resize(clusters * 2);
+    std::vector<std::vector<GLuint>> slice(count[2]);
+    std::vector<unsigned long long> dropped(count[2], 0);
+    parallelFor(0, count[2], [&](int b, int e)
+    {
+      std::vector<GLuint> candidate;
+      for (int z = b; z < e; ++z)
+      {
+        // スライスの手前と奥の距離
+        const GLfloat zn(n * pow(f / n, static_cast<GLfloat>(z) / count[2]));
+        const GLfloat zf(n * pow(f / n, static_cast<GLfloat>(z + 1) / count[2]));
+
+        // このスライスに届く光源
+        candidate.clear();
+        for (std::size_t i = 0; i < lights; ++i)
+        {
+          const GLfloat *const d(data.data() + i * 16);
+          if (d[2] - d[3] < -zn && d[2] + d[3] > -zf) candidate.emplace_back(static_cast<GLuint>(i));
+        }
+
+        for (int y = 0; y < count[1]; ++y)
+        {
+          // タイルの正規化デバイス座標系における範囲から視点座標系における範囲を求める
+          const GLfloat y0(2.0f * y / count[1] - 1.0f), y1(2.0f * (y + 1) / count[1] - 1.0f);
+          const GLfloat ymin(std::min(y0 * zn, y0 * zf) / projection[5]);
+          const GLfloat ymax(std::max(y1 * zn, y1 * zf) / projection[5]);
+
+          for (int x = 0; x < count[0]; ++x)
+          {
+            const GLfloat x0(2.0f * x / count[0] - 1.0f), x1(2.0f * (x + 1) / count[0] - 1.0f);
+            const GLfloat xmin(std::min(x0 * zn, x0 * zf) / projection[0]);
+            const GLfloat xmax(std::max(x1 * zn, x1 * zf) / projection[0]);
+
+            // クラスタの境界ボックスと光源の影響範囲の球が交わるか調べる
+            const GLint c((z * count[1] + y) * count[0] + x);
+            grid[c * 2] = static_cast<GLuint>(slice[z].size());
+            for (GLuint i : candidate)
+            {
+              const GLfloat *const d(data.data() + i * 16);
+              const GLfloat dx(d[0] - std::max(xmin, std::min(d[0], xmax)));
+              const GLfloat dy(d[1] - std::max(ymin, std::min(d[1], ymax)));
+              const GLfloat dz(d[2] - std::max(-zf, std::min(d[2], -zn)));
+              if (dx * dx + dy * dy + dz * dz < d[3] * d[3])
+              {
+                // 上限に達していれば割り当てない
+                if (slice[z].size() - grid[c * 2] < limit)
+                  slice[z].emplace_back(i);
+                else
+                  ++dropped[z];
+              }
+            }
+            grid[c * 2 + 1] = static_cast<GLuint>(slice[z].size()) - grid[c * 2];
+          }
+        }
+      }
+    });
+
+    // スライスごとの光源の番号の並びをつなぐ
+    index.clear();
+    for (int z = 0; z < count[2]; ++z)
+    {
+      const GLuint base(static_cast<GLuint>(index.size()));
+      for (GLint c = z * count[0] * count[1]; c < (z + 1) * count[0] * count[1]; ++c)
+        grid[c * 2] += base;
+      index.insert(index.end(), slice[z].begin(), slice[z].end());
+    }
+    Stats &s(stats());
+    s.references += index.size();
+    s.clusters += clusters;
+    for (unsigned long long d : dropped) s.dropped += d;
+    if (index.empty()) index.emplace_back(0);
+
+    // 転送する
+    upload(0, data.size() * sizeof (GLfloat), data.data());
+    upload(1, grid.size() * sizeof (GLuint), grid.data());
+    upload(2, index.size() * sizeof (GLuint), index.data());
+  }
+
+  // テクスチャユニットに光源, クラスタ, 光源の番号の並びのテクスチャを結合する
+  //   unit: 光源のテクスチャを結合するテクスチャユニット (続く二つにも結合する)
+  void bind(GLuint unit) const
+  {
+    for (GLuint i = 0; i < 3; ++i)
+    {
+      glActiveTexture(GL_TEXTURE0 + unit + i);
+      glBindTexture(GL_TEXTURE_BUFFER, texture[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // 横, 縦, 奥行き方向のクラスタの数を取り出す
+  const GLint *getCount() const
+  {
+    return count;
+  }
+
+  // ビューポートを取り出す
+  const GLfloat *getViewport() const
+  {
+    return viewport;
+  }
+
+  // 前方面の距離と奥行き方向の分割の係数を取り出す
+  const GLfloat *getDepth() const
+  {
+    return depth;
+  }
+};
@@ -0,0 +1,130 @@
+﻿#pragma once
+#include <cstddef>
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+//
+// ファイルをメモリに割り当てて読み出す (内容は複製しない)
+//
+class MappedFile
+{
+  // 割り当てたメモリの先頭
+  const char *address;
+
+  // ファイルのサイズ
+  std::size_t length;
+
+#if defined(_WIN32)
+  // ファイルマッピングオブジェクト
+  HANDLE mapping;
+#endif
+
+  // コピーコンストラクタによるコピー禁止
+  MappedFile(const MappedFile &f);
+
+  // 代入によるコピー禁止
+  MappedFile &operator=(const MappedFile &f);
+
+public:
+
+  // コンストラクタ (開けなければ割り当てない)
+  //   name: ファイル名
+  MappedFile(const char *name)
+    : address(NULL), length(0)
+  {
+#if defined(_WIN32)
+    mapping = NULL;
+    const HANDLE file(CreateFileA(name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size))
+    {
+      length = static_cast<std::size_t>(size.QuadPart);
+
+      // 空のファイルは割り当てられないので空の文字列を指す
+      if (length == 0)
+        address = "";
+      else
+      {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+          address = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+          // 割り当てられなければファイルマッピングオブジェクトはすぐに閉じる
+          if (address == NULL)
+          {
+            CloseHandle(mapping);
+            mapping = NULL;
+          }
+        }
+      }
+    }
+    CloseHandle(file);
+#else
+    const int fd(open(name, O_RDONLY));
+    if (fd < 0) return;
+
+    struct stat s;
+    if (fstat(fd, &s) == 0)
+    {
+      length = static_cast<std::size_t>(s.st_size);
+
+      // 空のファイルは割り当てられないので空の文字列を指す
+      if (length == 0)
+        address = "";
+      else
+      {
+        void *const p(mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (p != MAP_FAILED) address = static_cast<const char *>(p);
+      }
+    }
+    close(fd);
+#endif
+
+    if (address == NULL) length = 0;
+  }
+
+  // デストラクタ
+  ~MappedFile()
+  {
+#if defined(_WIN32)
+    if (address != NULL && length > 0) UnmapViewOfFile(address);
+    if (mapping != NULL) CloseHandle(mapping);
+#else
+    if (address != NULL && length > 0) munmap(const_cast<char *>(address), length);
+#endif
+  }
+
+  // 割り当てられていれば true
+  explicit operator bool() const
+  {
+    return address != NULL;
+  }
+
+  // 割り当てたメモリの先頭を取り出す
+  const char *get() const
+  {
+    return address;
+  }
+
+  // ファイルのサイズを取り出す
+  std::size_t size() const
+  {
+    return length;
+  }
+};
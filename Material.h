@@ -1,7 +1,11 @@
 ﻿#pragma once
 #include <array>
+#include <cstddef>
 #include <GL/glew.h>
 
+// uniform ブロックの配置
+#include "Layout.h"
+
 //
 // 材質データ
 //
@@ -19,3 +23,14 @@ struct Material
   // 輝き係数
   alignas(4) GLfloat shininess;
 };
+
+// point.frag の uniform ブロック Material の配置
+typedef Layout<Packing::Std140,
+  glsl::Vec<3>, glsl::Vec<3>, glsl::Vec<3>, glsl::Scalar> MaterialLayout;
+
+// 構造体の配置が uniform ブロックの配置と一致していることを確かめる
+static_assert(offsetof(Material, ambient) == MaterialLayout::offset(0), "Material::ambient is misplaced");
+static_assert(offsetof(Material, diffuse) == MaterialLayout::offset(1), "Material::diffuse is misplaced");
+static_assert(offsetof(Material, specular) == MaterialLayout::offset(2), "Material::specular is misplaced");
+static_assert(offsetof(Material, shininess) == MaterialLayout::offset(3), "Material::shininess is misplaced");
+static_assert(sizeof (Material) == MaterialLayout::bytes(), "Material does not match std140");
@@ -0,0 +1,172 @@
+﻿#pragma once
+#include <vector>
+#include <cstddef>
+#include <GL/glew.h>
+
+// 材質データ
+#include "Material.h"
+
+// 書き換えた範囲
+#include "DirtyRange.h"
+
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
+//
+// 全ての材質をまとめて格納したテクスチャバッファオブジェクト
+//
+class MaterialTable
+{
+  // 材質の CPU 側の写し
+  std::vector<Material> material;
+
+  // 書き換えた材質の範囲
+  DirtyRange dirty;
+
+  // バッファオブジェクト名とテクスチャ名
+  GLuint buffer, texture;
+
+  // バッファオブジェクトに確保した材質の数
+  GLsizei capacity;
+
+  // テクスチャに今のバッファオブジェクトを割り当てていれば true
+  bool attached;
+
+  // コピーコンストラクタによるコピー禁止
+  MaterialTable(const MaterialTable &t);
+
+  // 代入によるコピー禁止
+  MaterialTable &operator=(const MaterialTable &t);
+
+public:
+
+  // 一つの材質は std140 の配置のまま vec4 の 3 テクセルに収まる (輝き係数は 3 テクセル目の w)
+  static_assert(sizeof (Material) == 3 * 4 * sizeof (GLfloat), "Material must be three texels");
+  static_assert(MaterialLayout::offset(3) == 11 * sizeof (GLfloat), "Kshi must be in the w of the third texel");
+
+  // 統計
+  struct Stats
+  {
+    // バッファオブジェクトへの転送の回数
+    unsigned long long uploads;
+
+    // 転送した材質の数
+    unsigned long long slots;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   data: 材質データ
+  //   count: 材質の数
+  MaterialTable(const Material *data = NULL, unsigned int count = 0)
+    : material(data, data + count), buffer(0), capacity(0), attached(false)
+  {
+    glGenTextures(1, &texture);
+  }
+
+  // デストラクタ
+  ~MaterialTable()
+  {
+    glDeleteTextures(1, &texture);
+    ReleaseQueue::get().deleteBuffer(buffer, capacity * sizeof (Material), GL_DYNAMIC_DRAW);
+  }
+
+  // 材質を追加する
+  //   m: 材質
+  //   戻り値: 追加した材質の番号
+  unsigned int add(const Material &m)
+  {
+    material.emplace_back(m);
+    const GLsizei i(static_cast<GLsizei>(material.size()) - 1);
+    dirty.mark(i, 1);
+    return static_cast<unsigned int>(i);
+  }
+
+  // 材質を書き換える
+  //   i: 材質の番号
+  //   m: 材質
+  void set(unsigned int i, const Material &m)
+  {
+    material[i] = m;
+    dirty.mark(static_cast<GLsizei>(i), 1);
+  }
+
+  // 材質を取り出す
+  //   i: 材質の番号
+  const Material &get(unsigned int i) const
+  {
+    return material[i];
+  }
+
+  // 材質の数を取り出す
+  unsigned int size() const
+  {
+    return static_cast<unsigned int>(material.size());
+  }
+
+  // 書き換えた材質だけを転送する
+  void update()
+  {
+    const GLsizei count(static_cast<GLsizei>(material.size()));
+    if (count > capacity)
+    {
+      // 入りきらなければ倍々に大きくして全体を転送する
+      ReleaseQueue &queue(ReleaseQueue::get());
+      queue.deleteBuffer(buffer, capacity * sizeof (Material), GL_DYNAMIC_DRAW);
+      if (capacity == 0) capacity = 64;
+      while (capacity < count) capacity *= 2;
+      buffer = queue.createBuffer(GL_TEXTURE_BUFFER, capacity * sizeof (Material), NULL, GL_DYNAMIC_DRAW);
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof (Material), material.data());
+      dirty.clear();
+
+      // テクスチャへの割り当ては結合するテクスチャユニットを選んでから bind() で行う
+      attached = false;
+
+      Stats &s(stats());
+      ++s.uploads;
+      s.slots += count;
+      return;
+    }
+
+    if (dirty.empty()) return;
+
+    // 書き換えた材質の範囲ごとに転送する
+    State::get().bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    for (const auto &r : dirty.coalesce(0))
+    {
+      glBufferSubData(GL_TEXTURE_BUFFER, r.first * sizeof (Material),
+        (r.second - r.first) * sizeof (Material), material.data() + r.first);
+
+      Stats &s(stats());
+      ++s.uploads;
+      s.slots += r.second - r.first;
+    }
+    dirty.clear();
+  }
+
+  // テクスチャユニットに結合する
+  //   unit: テクスチャユニット
+  void bind(GLuint unit)
+  {
+    // 書き換えた材質があれば転送する
+    update();
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+
+    // バッファオブジェクトを作り直していればテクスチャに割り当て直す
+    if (!attached)
+    {
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+      attached = true;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+  }
+};
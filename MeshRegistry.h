@@ -0,0 +1,187 @@
+﻿#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <GL/glew.h>
+
+// 図形データ
+#include "Object.h"
+
+// 資源の管理
+#include "Resource.h"
+
+// 頂点の溶接
+#include "Weld.h"
+
+// ハッシュ関数
+#include "Hash.h"
+
+//
+// 内容が同じ図形データを共有する登録簿
+//
+class MeshRegistry
+{
+  // 登録された図形データ
+  struct Entry
+  {
+    // 図形データのハンドル
+    Handle<Object> object;
+
+    // 頂点の位置の次元と溶接に使った基本図形の頂点数
+    GLint size, primitive;
+
+    // 頂点の数と頂点のインデックスの要素数
+    GLsizei vertexcount, indexcount;
+
+    // 元の頂点属性と頂点のインデックスの内容 (ハッシュ値が衝突していないか確かめる)
+    std::vector<char> bytes;
+
+    // 図形データを使っている数
+    unsigned int count;
+  };
+
+  // 内容のハッシュ値をキーにした図形データの表
+  std::unordered_map<std::uint64_t, Entry> entry;
+
+  // 図形データのハンドルからハッシュ値を引く表
+  std::unordered_map<std::uint32_t, std::uint64_t> key;
+
+  // 転送したバイト数
+  unsigned long long uploadedBytes;
+
+  // 共有によって転送せずに済んだバイト数
+  unsigned long long deduplicatedBytes;
+
+  // コピーコンストラクタによるコピー禁止
+  MeshRegistry(const MeshRegistry &r);
+
+  // 代入によるコピー禁止
+  MeshRegistry &operator=(const MeshRegistry &r);
+
+  // 登録された図形データと内容が同じなら true
+  //   e: 登録された図形データ
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  //   primitive: 溶接に使う基本図形の頂点数
+  static bool same(const Entry &e, GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index, GLsizei primitive)
+  {
+    const std::size_t vertexBytes(vertexcount * sizeof (Object::Vertex));
+    const std::size_t indexBytes(index ? indexcount * sizeof (GLuint) : 0);
+    return e.size == size && e.primitive == primitive
+      && e.vertexcount == vertexcount && e.indexcount == indexcount
+      && e.bytes.size() == vertexBytes + indexBytes
+      && (vertexBytes == 0 || std::memcmp(e.bytes.data(), vertex, vertexBytes) == 0)
+      && (indexBytes == 0 || std::memcmp(e.bytes.data() + vertexBytes, index, indexBytes) == 0);
+  }
+
+public:
+
+  // コンストラクタ
+  MeshRegistry()
+    : uploadedBytes(0), deduplicatedBytes(0)
+  {
+  }
+
+  // デストラクタ
+  virtual ~MeshRegistry()
+  {
+    // 残っている図形データを解放する
+    for (const auto &e : entry) Resource<Object>::pool().release(e.second.object);
+  }
+
+  // 図形データを取り出す (内容が同じものがあればそれを返す)
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  //   primitive: 溶接に使う基本図形の頂点数 (0 なら溶接しない)
+  Handle<Object> get(GLint size,
+    GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount = 0, const GLuint *index = NULL, GLsizei primitive = 0)
+  {
+    // 頂点属性と頂点のインデックスのバイト数
+    const std::size_t vertexBytes(vertexcount * sizeof (Object::Vertex));
+    const std::size_t indexBytes(index ? indexcount * sizeof (GLuint) : 0);
+
+    // 内容と形式からハッシュ値を求める
+    const std::int32_t format[] = { size, vertexcount, indexcount, primitive };
+    std::uint64_t hash(Hash::compute(format, sizeof format));
+    hash = Hash::compute(vertex, vertexBytes, hash);
+    hash = Hash::compute(index, indexBytes, hash);
+
+    // 同じ内容の図形データがあればそれを使う (ハッシュ値だけでなく内容も比べる)
+    const auto found(entry.find(hash));
+    if (found != entry.end() && same(found->second, size, vertexcount, vertex,
+      indexcount, index, primitive))
+    {
+      deduplicatedBytes += vertexBytes + indexBytes;
+      ++found->second.count;
+      return found->second.object;
+    }
+
+    // 頂点を溶接して図形データを作成する
+    const Weld weld(vertexcount, vertex, indexcount, index, primitive);
+    const Handle<Object> object(Resource<Object>::pool().create(size,
+      weld.getVertexCount(), weld.getVertex(), weld.getIndexCount(), weld.getIndex()));
+    uploadedBytes += weld.getVertexCount() * sizeof (Object::Vertex)
+      + (index ? weld.getIndexCount() * sizeof (GLuint) : 0);
+
+    // ハッシュ値が衝突していなければ登録する (衝突したものは共有しない)
+    if (found == entry.end())
+    {
+      Entry &e(entry[hash]);
+      e.object = object;
+      e.size = size;
+      e.primitive = primitive;
+      e.vertexcount = vertexcount;
+      e.indexcount = indexcount;
+      e.bytes.resize(vertexBytes + indexBytes);
+      if (vertexBytes > 0) std::memcpy(e.bytes.data(), vertex, vertexBytes);
+      if (indexBytes > 0) std::memcpy(e.bytes.data() + vertexBytes, index, indexBytes);
+      e.count = 1;
+      key.emplace(object.get(), hash);
+    }
+
+    return object;
+  }
+
+  // 取り出した図形データを返却する (使われなくなれば解放する)
+  //   object: 図形データのハンドル
+  void release(Handle<Object> object)
+  {
+    // 共有していない図形データはすぐに解放する
+    const auto k(key.find(object.get()));
+    if (k == key.end())
+    {
+      Resource<Object>::pool().release(object);
+      return;
+    }
+
+    // 使っている数が 0 になれば解放する
+    const auto e(entry.find(k->second));
+    if (--e->second.count == 0)
+    {
+      Resource<Object>::pool().release(object);
+      entry.erase(e);
+      key.erase(k);
+    }
+  }
+
+  // 転送したバイト数を取り出す
+  unsigned long long getUploadedBytes() const
+  {
+    return uploadedBytes;
+  }
+
+  // 共有によって転送せずに済んだバイト数を取り出す
+  unsigned long long getDeduplicatedBytes() const
+  {
+    return deduplicatedBytes;
+  }
+};
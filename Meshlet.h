@@ -0,0 +1,305 @@
+﻿#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+
+// 図形データ
+#include "Object.h"
+
+//
+// メッシュレット (三角形のクラスタ)
+//
+struct Meshlet
+{
+  // 一つのメッシュレットの頂点の最大数
+  static constexpr GLuint maxVertices = 64;
+
+  // 一つのメッシュレットの三角形の最大数
+  static constexpr GLuint maxTriangles = 124;
+
+  // 局所的な頂点番号の表の先頭位置
+  GLuint vertexoffset;
+
+  // 三角形の表の先頭位置 (三角形の番号)
+  GLuint triangleoffset;
+
+  // 頂点の数
+  GLuint vertexcount;
+
+  // 三角形の数
+  GLuint trianglecount;
+
+  // 境界球の中心
+  GLfloat center[3];
+
+  // 境界球の半径
+  GLfloat radius;
+
+  // 法線錐の軸
+  GLfloat axis[3];
+
+  // 法線錐の開き (背面判定のしきい値, 1 なら判定しない)
+  GLfloat cutoff;
+};
+
+//
+// メッシュレットの作成
+//
+class MeshletBuilder
+{
+  // メッシュレット
+  std::vector<Meshlet> meshlet;
+
+  // メッシュレットの局所的な頂点番号に対応する頂点の番号
+  std::vector<GLuint> vertexmap;
+
+  // メッシュレットの三角形の局所的な頂点番号 (三角形あたり 3 個)
+  std::vector<GLubyte> triangle;
+
+  // メッシュレットの順に並べた頂点のインデックス
+  std::vector<GLuint> index;
+
+  // 作成中のメッシュレットの境界球と法線錐を求める
+  //   m: 作成中のメッシュレット
+  //   v: 頂点属性を格納した配列
+  void bound(Meshlet &m, const Object::Vertex *v) const
+  {
+    // 頂点位置の範囲の中心を境界球の中心にする
+    GLfloat pmin[3], pmax[3];
+    const GLfloat *const p0(v[vertexmap[m.vertexoffset]].position);
+    std::copy(p0, p0 + 3, pmin);
+    std::copy(p0, p0 + 3, pmax);
+    for (GLuint i = 1; i < m.vertexcount; ++i)
+    {
+      const GLfloat *const p(v[vertexmap[m.vertexoffset + i]].position);
+      for (int k = 0; k < 3; ++k)
+      {
+        pmin[k] = std::min(pmin[k], p[k]);
+        pmax[k] = std::max(pmax[k], p[k]);
+      }
+    }
+    for (int k = 0; k < 3; ++k) m.center[k] = (pmin[k] + pmax[k]) * 0.5f;
+
+    // 中心から最も遠い頂点までの距離を半径にする
+    GLfloat r2(0.0f);
+    for (GLuint i = 0; i < m.vertexcount; ++i)
+    {
+      const GLfloat *const p(v[vertexmap[m.vertexoffset + i]].position);
+      const GLfloat dx(p[0] - m.center[0]), dy(p[1] - m.center[1]), dz(p[2] - m.center[2]);
+      r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    m.radius = sqrt(r2);
+
+    // 三角形の法線ベクトル
+    std::vector<GLfloat> normal;
+    normal.reserve(m.trianglecount * 3);
+    GLfloat a[3] = { 0.0f, 0.0f, 0.0f };
+    for (GLuint t = 0; t < m.trianglecount; ++t)
+    {
+      const GLubyte *const l(&triangle[(m.triangleoffset + t) * 3]);
+      const GLfloat *const p0(v[vertexmap[m.vertexoffset + l[0]]].position);
+      const GLfloat *const p1(v[vertexmap[m.vertexoffset + l[1]]].position);
+      const GLfloat *const p2(v[vertexmap[m.vertexoffset + l[2]]].position);
+      const GLfloat e1[] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      const GLfloat e2[] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      const GLfloat n[] =
+      {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0]
+      };
+
+      // 面積のない三角形は法線錐に含めない
+      const GLfloat l2(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (l2 <= 0.0f) continue;
+
+      const GLfloat s(1.0f / sqrt(l2));
+      for (int k = 0; k < 3; ++k)
+      {
+        normal.emplace_back(n[k] * s);
+        a[k] += n[k] * s;
+      }
+    }
+
+    // 法線ベクトルの平均を法線錐の軸にする
+    const GLfloat al(sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]));
+    m.cutoff = 1.0f;
+    std::fill(m.axis, m.axis + 3, 0.0f);
+    if (al <= 0.0f) return;
+    for (int k = 0; k < 3; ++k) m.axis[k] = a[k] / al;
+
+    // 軸と法線ベクトルのなす角の最大値から法線錐の開きを求める
+    GLfloat d(1.0f);
+    for (std::size_t i = 0; i < normal.size(); i += 3)
+      d = std::min(d, normal[i] * m.axis[0] + normal[i + 1] * m.axis[1] + normal[i + 2] * m.axis[2]);
+
+    // 開きが半球を超えれば背面判定はできない
+    if (d > 0.0f) m.cutoff = sqrt(1.0f - d * d);
+  }
+
+  // 作成中のメッシュレットを確定して次のメッシュレットを始める
+  //   m: 作成中のメッシュレット
+  //   v: 頂点属性を格納した配列
+  //   local: 頂点の局所的な番号
+  void finish(Meshlet &m, const Object::Vertex *v, std::vector<GLint> &local)
+  {
+    // 局所的な番号を未登録に戻す
+    for (GLuint i = 0; i < m.vertexcount; ++i) local[vertexmap[m.vertexoffset + i]] = -1;
+
+    // 境界球と法線錐を求めて登録する
+    bound(m, v);
+    meshlet.emplace_back(m);
+
+    // 次のメッシュレットを空にする
+    const Meshlet n = { static_cast<GLuint>(vertexmap.size()),
+      static_cast<GLuint>(triangle.size() / 3) };
+    m = n;
+  }
+
+public:
+
+  // コンストラクタ
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  MeshletBuilder(GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+  {
+    // 三角形の数
+    const GLsizei count(indexcount / 3);
+
+    // 頂点ごとにその頂点を共有する三角形の表を作る
+    std::vector<GLsizei> first(vertexcount + 1, 0);
+    for (GLsizei i = 0; i < count * 3; ++i) ++first[index[i] + 1];
+    for (GLsizei i = 0; i < vertexcount; ++i) first[i + 1] += first[i];
+    std::vector<GLsizei> adjacency(count * 3);
+    std::vector<GLsizei> fill(first.begin(), first.end() - 1);
+    for (GLsizei i = 0; i < count * 3; ++i) adjacency[fill[index[i]]++] = i / 3;
+
+    // 三角形の法線ベクトルを求める
+    std::vector<GLfloat> normal(count * 3, 0.0f);
+    for (GLsizei t = 0; t < count; ++t)
+    {
+      const GLfloat *const p0(vertex[index[t * 3]].position);
+      const GLfloat *const p1(vertex[index[t * 3 + 1]].position);
+      const GLfloat *const p2(vertex[index[t * 3 + 2]].position);
+      const GLfloat e1[] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      const GLfloat e2[] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      GLfloat *const n(&normal[t * 3]);
+      n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      const GLfloat l(sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]));
+      if (l > 0.0f) for (int k = 0; k < 3; ++k) n[k] /= l;
+    }
+
+    // 頂点の作成中のメッシュレットにおける局所的な番号 (-1 なら未登録)
+    std::vector<GLint> local(vertexcount, -1);
+
+    // 三角形を加えたときに新たに登録される頂点の数を求める
+    const auto added([&](GLsizei t)
+    {
+      const GLuint *const i(index + t * 3);
+      GLuint n(0);
+      for (int k = 0; k < 3; ++k)
+        if (local[i[k]] < 0 && (k < 1 || i[k] != i[0]) && (k < 2 || i[k] != i[1])) ++n;
+      return n;
+    });
+
+    // メッシュレットに登録済みの三角形
+    std::vector<bool> emitted(count, false);
+
+    // 未登録の三角形を探す位置
+    GLsizei seed(0);
+
+    // 作成中のメッシュレットとその法線ベクトルの和
+    Meshlet m = {};
+    GLfloat axis[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (;;)
+    {
+      // 作成中のメッシュレットと頂点を共有する三角形のうち
+      // 新たに登録される頂点が少なく向きの近いものを選ぶ
+      GLsizei best(-1);
+      GLuint bestcount(4);
+      GLfloat bestdot(-2.0f);
+      for (GLuint i = 0; i < m.vertexcount; ++i)
+      {
+        const GLuint v(vertexmap[m.vertexoffset + i]);
+        for (GLsizei j = first[v]; j < first[v + 1]; ++j)
+        {
+          const GLsizei t(adjacency[j]);
+          if (emitted[t]) continue;
+
+          const GLuint c(added(t));
+          const GLfloat *const n(&normal[t * 3]);
+          const GLfloat d(n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+          if (c < bestcount || (c == bestcount && d > bestdot))
+          {
+            best = t;
+            bestcount = c;
+            bestdot = d;
+          }
+        }
+      }
+
+      // 頂点を共有する三角形がなければ未登録の三角形を先頭から探す
+      if (best < 0)
+      {
+        while (seed < count && emitted[seed]) ++seed;
+        if (seed >= count) break;
+        best = seed;
+        bestcount = added(best);
+      }
+
+      // 頂点か三角形の数が上限を超えるならメッシュレットを確定する
+      if (m.vertexcount + bestcount > Meshlet::maxVertices ||
+        m.trianglecount + 1 > Meshlet::maxTriangles)
+      {
+        finish(m, vertex, local);
+        std::fill(axis, axis + 3, 0.0f);
+      }
+
+      // 三角形の頂点を登録する
+      for (int k = 0; k < 3; ++k)
+      {
+        GLint &l(local[index[best * 3 + k]]);
+        if (l < 0)
+        {
+          l = static_cast<GLint>(m.vertexcount++);
+          vertexmap.emplace_back(index[best * 3 + k]);
+        }
+        triangle.emplace_back(static_cast<GLubyte>(l));
+        axis[k] += normal[best * 3 + k];
+      }
+      emitted[best] = true;
+      ++m.trianglecount;
+    }
+
+    // 最後のメッシュレットを確定する
+    if (m.trianglecount > 0) finish(m, vertex, local);
+
+    // メッシュレットの順に頂点のインデックスを並べ直す
+    this->index.reserve(triangle.size());
+    for (const Meshlet &n : meshlet)
+    {
+      const GLubyte *const t(&triangle[n.triangleoffset * 3]);
+      for (GLuint i = 0; i < n.trianglecount * 3; ++i)
+        this->index.emplace_back(vertexmap[n.vertexoffset + t[i]]);
+    }
+  }
+
+  // メッシュレットを取り出す
+  const std::vector<Meshlet> &getMeshlet() const
+  {
+    return meshlet;
+  }
+
+  // メッシュレットの順に並べた頂点のインデックスを取り出す
+  const std::vector<GLuint> &getIndex() const
+  {
+    return index;
+  }
+};
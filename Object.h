@@ -1,7 +1,19 @@
 ﻿#pragma once
 #include <array>
+#include <vector>
+#include <cstring>
+#include <algorithm>
 #include <GL/glew.h>
 
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
+// OpenGL の状態の記録
+#include "State.h"
+
+// 頂点属性の配置
+#include "VertexFormat.h"
+
 //
 // 図形データ
 //
@@ -10,12 +22,45 @@ class Object
   // 頂点配列オブジェクト名
   GLuint vao;
 
+  // 位置だけを参照する頂点配列オブジェクト名
+  GLuint depthvao;
+
   // 頂点バッファオブジェクト名
   GLuint vbo;
 
   // インデックスの頂点バッファオブジェクト
   GLuint ibo;
 
+  // 頂点の数
+  GLsizei vertexcount;
+
+  // 頂点のインデックスの要素数
+  GLsizei indexcount;
+
+  // 頂点バッファオブジェクト内の属性ごとの先頭位置と間隔
+  GLintptr location[2];
+  GLsizei stride[2];
+
+  // 図形データを削除する
+  void destroy()
+  {
+    // 移動済みなら何もしない
+    if (vao == 0) return;
+
+    // GPU が使い終わってから削除する
+    ReleaseQueue &queue(ReleaseQueue::get());
+
+    // 頂点配列オブジェクトを削除する
+    queue.deleteVertexArray(vao);
+    queue.deleteVertexArray(depthvao);
+
+    // 頂点バッファオブジェクトを削除する
+    queue.deleteBuffer(vbo, vertexcount * sizeof (Vertex), GL_STATIC_DRAW);
+
+    // インデックスの頂点バッファオブジェクトを削除する
+    queue.deleteBuffer(ibo, indexcount * sizeof (GLuint), GL_STATIC_DRAW);
+  }
+
 public:
 
   // 頂点属性
@@ -28,50 +73,121 @@ public:
     GLfloat normal[3];
   };
 
-  // コンストラクタ
+  // 頂点属性の配置を指定するコンストラクタ
   //   size: 頂点の位置の次元
   //   vertexcount: 頂点の数
   //   vertex: 頂点属性を格納した配列
   //   indexcount: 頂点のインデックスの要素数
   //   index: 頂点のインデックスを格納した配列
+  //   format: 頂点属性の配置
+  template <VertexLayout L>
   Object(GLint size, GLsizei vertexcount, const Vertex *vertex,
-    GLsizei indexcount, const GLuint *index)
+    GLsizei indexcount, const GLuint *index, VertexFormat<L> format)
+    : vertexcount(vertexcount), indexcount(indexcount)
   {
+    static_assert(sizeof (Vertex) == VertexFormat<VertexLayout::Interleaved>::stride(0),
+      "Object::Vertex does not match the vertex format");
+
+    // 頂点属性を指定した配置に並べ替える
+    std::vector<char> buffer;
+    const GLvoid *data(vertex);
+    if (L != VertexLayout::Interleaved && vertex != NULL)
+    {
+      buffer.resize(vertexcount * sizeof (Vertex));
+      for (int a = 0; a < format.attributes; ++a)
+      {
+        const int s(format.stream(a));
+        char *p(buffer.data() + format.base(s, vertexcount) + format.offset(a));
+        const GLsizei from(a == 0 ? 0 : sizeof vertex->position);
+        for (GLsizei i = 0; i < vertexcount; ++i, p += format.stride(s))
+          std::memcpy(p, reinterpret_cast<const char *>(vertex + i) + from, format.bytes(a));
+      }
+      data = buffer.data();
+    }
+
     // 頂点配列オブジェクト
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    State::get().bindVertexArray(vao);
 
-    // 頂点バッファオブジェクト
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-      vertexcount * sizeof (Vertex), vertex, GL_STATIC_DRAW);
+    // 頂点バッファオブジェクト (同じサイズの空きがあれば再利用する)
+    ReleaseQueue &queue(ReleaseQueue::get());
+    vbo = queue.createBuffer(GL_ARRAY_BUFFER,
+      vertexcount * sizeof (Vertex), data, GL_STATIC_DRAW);
 
     // 結合されている頂点バッファオブジェクトを in 変数から参照できるようにする
-    glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, sizeof (Vertex), 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex),
-      static_cast<char *>(0) + sizeof vertex->position);
-    glEnableVertexAttribArray(1);
+    for (int a = 0; a < format.attributes; ++a)
+    {
+      const int s(format.stream(a));
+      location[a] = format.base(s, vertexcount) + format.offset(a);
+      stride[a] = format.stride(s);
+      glVertexAttribPointer(a, a == 0 ? size : format.components(a), GL_FLOAT, GL_FALSE,
+        stride[a], static_cast<char *>(0) + location[a]);
+      glEnableVertexAttribArray(a);
+    }
 
     // インデックスの頂点バッファオブジェクト
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+    ibo = queue.createBuffer(GL_ELEMENT_ARRAY_BUFFER,
       indexcount * sizeof (GLuint), index, GL_STATIC_DRAW);
+
+    // 位置だけを参照する頂点配列オブジェクト
+    glGenVertexArrays(1, &depthvao);
+    State::get().bindVertexArray(depthvao);
+    State::get().bindBuffer(GL_ARRAY_BUFFER, vbo);
+    const int s(format.stream(0));
+    glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE,
+      format.stride(s), static_cast<char *>(0) + format.base(s, vertexcount) + format.offset(0));
+    glEnableVertexAttribArray(0);
+    State::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  }
+
+  // コンストラクタ (位置とそれ以外の属性を分けて配置する)
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  Object(GLint size, GLsizei vertexcount, const Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+    : Object(size, vertexcount, vertex, indexcount, index,
+      VertexFormat<VertexLayout::Split>())
+  {
+  }
+
+  // ムーブコンストラクタ
+  Object(Object &&o)
+    : vao(o.vao), depthvao(o.depthvao), vbo(o.vbo), ibo(o.ibo)
+    , vertexcount(o.vertexcount), indexcount(o.indexcount)
+  {
+    std::copy(o.location, o.location + 2, location);
+    std::copy(o.stride, o.stride + 2, stride);
+    o.vao = o.depthvao = o.vbo = o.ibo = 0;
   }
 
   // デストラクタ
   virtual ~Object()
   {
-    // 頂点配列オブジェクトを削除する
-    glDeleteVertexArrays(1, &vao);
+    destroy();
+  }
 
-    // 頂点バッファオブジェクトを削除する
-    glDeleteBuffers(1, &vbo);
+  // ムーブ代入
+  Object &operator=(Object &&o)
+  {
+    if (this != &o)
+    {
+      // 今の図形データを削除して移動元の図形データを引き継ぐ
+      destroy();
+      vao = o.vao;
+      depthvao = o.depthvao;
+      vbo = o.vbo;
+      ibo = o.ibo;
+      vertexcount = o.vertexcount;
+      indexcount = o.indexcount;
+      std::copy(o.location, o.location + 2, location);
+      std::copy(o.stride, o.stride + 2, stride);
+      o.vao = o.depthvao = o.vbo = o.ibo = 0;
+    }
 
-    // インデックスの頂点バッファオブジェクトを削除する
-    glDeleteBuffers(1, &ibo);
+    return *this;
   }
 
 private:
@@ -88,6 +204,57 @@ public:
   void bind() const
   {
     // 描画する頂点配列オブジェクトを指定する
-    glBindVertexArray(vao);
+    State::get().bindVertexArray(vao);
+  }
+
+  // 位置だけを参照する頂点配列オブジェクトの結合
+  void bindDepth() const
+  {
+    // デプスだけを描画するときの頂点配列オブジェクトを指定する
+    State::get().bindVertexArray(depthvao);
+  }
+
+  // 頂点配列オブジェクト名を取り出す
+  GLuint getVertexArray() const
+  {
+    return vao;
+  }
+
+  // 頂点の数を取り出す
+  GLsizei getVertexCount() const
+  {
+    return vertexcount;
+  }
+
+  // 頂点のインデックスの要素数を取り出す
+  GLsizei getIndexCount() const
+  {
+    return indexcount;
+  }
+
+  // 頂点属性と頂点のインデックスを GPU から読み出す (頂点属性は Vertex の並びに戻す)
+  //   vertex: 頂点属性の格納先
+  //   index: 頂点のインデックスの格納先
+  void read(std::vector<Vertex> &vertex, std::vector<GLuint> &index) const
+  {
+    // 頂点バッファオブジェクトの内容を読み出す
+    std::vector<char> buffer(vertexcount * sizeof (Vertex));
+    State::get().bindBuffer(GL_COPY_READ_BUFFER, vbo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, buffer.size(), buffer.data());
+
+    // 属性ごとに頂点属性の並びに戻す
+    vertex.resize(vertexcount);
+    for (GLsizei i = 0; i < vertexcount; ++i)
+    {
+      std::memcpy(vertex[i].position, buffer.data() + location[0] + i * stride[0],
+        sizeof vertex[i].position);
+      std::memcpy(vertex[i].normal, buffer.data() + location[1] + i * stride[1],
+        sizeof vertex[i].normal);
+    }
+
+    // 頂点のインデックスを読み出す
+    index.resize(indexcount);
+    State::get().bindBuffer(GL_COPY_READ_BUFFER, ibo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, indexcount * sizeof (GLuint), index.data());
   }
 };
@@ -0,0 +1,224 @@
+﻿#pragma once
+#include <memory>
+#include <GL/glew.h>
+
+// インデックスを使った三角形による描画
+#include "SolidShapeIndex.h"
+
+// 変換行列
+#include "Matrix.h"
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// オクルージョンクエリによる隠れた図形の描画の省略
+//
+class Occlusion
+{
+  // 描画する図形
+  const Shape &shape;
+
+  // 図形の境界ボックスの代理図形
+  std::unique_ptr<SolidShapeIndex> box;
+
+  // 境界ボックスの頂点の位置
+  GLfloat corner[8][3];
+
+  // クエリオブジェクト名
+  GLuint query;
+
+  // 結果を待っているクエリがあれば true
+  bool pending;
+
+  // 最後に分かった可視性
+  bool visible;
+
+  // 見えている図形を前回調べてから描いた回数と調べる間隔
+  unsigned int age, interval;
+
+  // コピーコンストラクタによるコピー禁止
+  Occlusion(const Occlusion &o);
+
+  // 代入によるコピー禁止
+  Occlusion &operator=(const Occlusion &o);
+
+  // 使用するクエリの種類を選ぶ
+  static GLenum target()
+  {
+    // 画素が一つでも通れば十分なので使えれば早く打ち切れる方を使う
+    return GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2 ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED;
+  }
+
+  // 境界ボックスが前方クリッピング面にかかるか調べる
+  //   mvp: 投影変換行列とモデルビュー変換行列の積
+  bool nearClipped(const Matrix &mvp) const
+  {
+    for (const GLfloat *p : corner)
+    {
+      const GLfloat z(mvp[2] * p[0] + mvp[6] * p[1] + mvp[10] * p[2] + mvp[14]);
+      const GLfloat w(mvp[3] * p[0] + mvp[7] * p[1] + mvp[11] * p[2] + mvp[15]);
+      if (z < -w) return true;
+    }
+    return false;
+  }
+
+  // 結果が届いていればクエリの結果を取り出す
+  void poll()
+  {
+    if (!pending) return;
+
+    GLuint available;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE) return;
+
+    GLuint samples;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+    visible = samples > 0;
+    pending = false;
+    age = 0;
+    if (!visible) ++stats().hidden;
+  }
+
+  // 境界ボックスを色もデプスも書き込まずに描いてクエリを発行する
+  void test()
+  {
+    // 現在の状態を記録から取り出して保存する (glGet* で描画を止めない)
+    State &state(State::get());
+    const GLboolean *const mask(state.getColorMask());
+    const GLboolean color[] = { mask[0], mask[1], mask[2], mask[3] };
+    const GLboolean depth(state.getDepthMask());
+    const bool cull(state.isEnabled(GL_CULL_FACE));
+
+    // 視点が箱の中になくても裏面まで調べる
+    state.colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.depthMask(GL_FALSE);
+    state.disable(GL_CULL_FACE);
+
+    glBeginQuery(target(), query);
+    box->drawDepth();
+    glEndQuery(target());
+
+    // 状態を元に戻す
+    state.colorMask(color[0], color[1], color[2], color[3]);
+    state.depthMask(depth);
+    if (cull) state.enable(GL_CULL_FACE);
+
+    pending = true;
+    ++stats().queries;
+    ++stats().proxies;
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 発行したクエリの数
+    unsigned long long queries;
+
+    // そのうち境界ボックスで調べた数
+    unsigned long long proxies;
+
+    // 隠れていると分かった数
+    unsigned long long hidden;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   shape: 描画する図形
+  //   min: モデル座標系における境界ボックスの最小の位置
+  //   max: モデル座標系における境界ボックスの最大の位置
+  //   interval: 見えている図形を調べ直す間隔のフレーム数
+  Occlusion(const Shape &shape, const GLfloat *min, const GLfloat *max,
+    unsigned int interval = 8)
+    : shape(shape), pending(false), visible(true), interval(interval)
+  {
+    // 境界ボックスの頂点
+    Object::Vertex vertex[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        corner[i][k] = vertex[i].position[k] = (i >> k) & 1 ? max[k] : min[k];
+        vertex[i].normal[k] = 0.0f;
+      }
+    }
+
+    // 境界ボックスの面
+    static const GLuint index[] =
+    {
+      0, 2, 3,  0, 3, 1,  4, 5, 7,  4, 7, 6,
+      0, 1, 5,  0, 5, 4,  2, 6, 7,  2, 7, 3,
+      0, 4, 6,  0, 6, 2,  1, 3, 7,  1, 7, 5
+    };
+    box.reset(new SolidShapeIndex(3, 8, vertex, 36, index));
+
+    // クエリオブジェクト
+    glGenQueries(1, &query);
+
+    // 調べ直すフレームが図形ごとにばらけるようにする
+    static unsigned int seed(0);
+    age = seed++ % (interval > 0 ? interval : 1);
+  }
+
+  // デストラクタ
+  ~Occlusion()
+  {
+    glDeleteQueries(1, &query);
+  }
+
+  // 最後に分かった可視性を取り出す
+  bool isVisible() const
+  {
+    return visible;
+  }
+
+  // 隠れていなければ描画する (手前の図形から順に呼び出す)
+  //   projection: 投影変換行列
+  //   modelview: モデルビュー変換行列
+  void draw(const Matrix &projection, const Matrix &modelview)
+  {
+    // 前のフレームまでに発行したクエリの結果を待たずに取り出す
+    poll();
+
+    // 境界ボックスが前方クリッピング面にかかっていたら調べずに描く
+    if (nearClipped(projection * modelview))
+    {
+      visible = true;
+      shape.draw();
+      return;
+    }
+
+    if (visible)
+    {
+      // 見えている図形は時々本物の描画でクエリを発行する
+      if (!pending && ++age >= interval)
+      {
+        glBeginQuery(target(), query);
+        shape.draw();
+        glEndQuery(target());
+        pending = true;
+        ++stats().queries;
+      }
+      else
+        shape.draw();
+
+      return;
+    }
+
+    // 隠れていた図形は境界ボックスで調べ直す
+    if (!pending) test();
+
+    // 結果を待たずに済む範囲でクエリの結果に従って描く
+    glBeginConditionalRender(query, GL_QUERY_NO_WAIT);
+    shape.draw();
+    glEndConditionalRender();
+  }
+};
@@ -0,0 +1,17 @@
+﻿#pragma once
+
+// 仕事を盗み合うスレッドプール
+#include "JobSystem.h"
+
+//
+// 添字の範囲を分割して並列に処理する
+//   begin: 範囲の先頭
+//   end: 範囲の末尾の次
+//   func: 添字の部分範囲 [b, e) を処理する関数
+//
+template <typename Func>
+inline void parallelFor(int begin, int end, Func func)
+{
+  // 全体で使うスレッドプールで処理する
+  JobSystem::get().parallelFor(begin, end, func);
+}
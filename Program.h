@@ -0,0 +1,688 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <GL/glew.h>
+
+// OpenGL の状態の記録
+#include "State.h"
+
+// プログラムオブジェクトのバイナリの保存
+#include "ProgramCache.h"
+
+// シェーダのソースファイルの前処理
+#include "ShaderSource.h"
+
+//
+// プログラムオブジェクト
+//
+class Program
+{
+  // アクティブな uniform 変数
+  struct Variable
+  {
+    // 名前 (配列なら [0] を除く)
+    std::string name;
+
+    // 場所
+    GLint location;
+
+    // 型
+    GLenum type;
+
+    // 配列の要素数
+    GLint size;
+
+    // 最後に送った値の格納場所の先頭と一要素のバイト数
+    std::size_t cache;
+    GLsizei bytes;
+
+    // 値を送ったことがあれば true
+    bool sent;
+  };
+
+  // アクティブな uniform ブロック
+  struct Block
+  {
+    // 名前
+    std::string name;
+
+    // 番号
+    GLuint index;
+
+    // サイズ
+    GLint size;
+  };
+
+  // アクティブな attribute 変数
+  struct Attribute
+  {
+    // 名前
+    std::string name;
+
+    // 場所
+    GLint location;
+
+    // 型
+    GLenum type;
+  };
+
+  // プログラムオブジェクト名
+  GLuint program;
+
+  // uniform 変数の表
+  std::vector<Variable> variable;
+
+  // uniform ブロックの表
+  std::vector<Block> block;
+
+  // attribute 変数の表
+  std::vector<Attribute> attribute;
+
+  // 最後に送った uniform 変数の値
+  std::vector<char> value;
+
+  // シェーダのソースファイル名
+  const std::string vert, frag;
+
+  // ソースファイルに差し込む #define の並び
+  const std::string defines;
+
+  // 読み込んだソースファイル (#include したファイルを含む)
+  std::vector<std::string> files;
+
+  // 今のプログラムオブジェクトのバイナリのキー
+  std::uint64_t key;
+
+  // 作り直しているプログラムオブジェクト名 (作り直していなければ 0) とそのバイナリのキー
+  GLuint pending;
+  std::uint64_t pendingKey;
+
+  // コピーコンストラクタによるコピー禁止
+  Program(const Program &p);
+
+  // 代入によるコピー禁止
+  Program &operator=(const Program &p);
+
+  // シェーダオブジェクトのコンパイル結果を表示する
+  //   shader: シェーダオブジェクト名
+  //   str: コンパイルエラーが発生した場所を示す文字列
+  static GLboolean printShaderInfoLog(GLuint shader, const char *str)
+  {
+    // コンパイル結果を取得する
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE) std::cerr << "Compile Error in " << str << std::endl;
+
+    // シェーダのコンパイル時のログの長さを取得する
+    GLsizei bufSize;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
+
+    if (bufSize > 1)
+    {
+      // シェーダのコンパイル時のログの内容を取得する
+      std::vector<GLchar> infoLog(bufSize);
+      GLsizei length;
+      glGetShaderInfoLog(shader, bufSize, &length, &infoLog[0]);
+      std::cerr << &infoLog[0] << std::endl;
+    }
+
+    return static_cast<GLboolean>(status);
+  }
+
+  // プログラムオブジェクトのリンク結果を表示する
+  //   program: プログラムオブジェクト名
+  static GLboolean printProgramInfoLog(GLuint program)
+  {
+    // リンク結果を取得する
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) std::cerr << "Link Error." << std::endl;
+
+    // シェーダのリンク時のログの長さを取得する
+    GLsizei bufSize;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufSize);
+
+    if (bufSize > 1)
+    {
+      // シェーダのリンク時のログの内容を取得する
+      std::vector<GLchar> infoLog(bufSize);
+      GLsizei length;
+      glGetProgramInfoLog(program, bufSize, &length, &infoLog[0]);
+      std::cerr << &infoLog[0] << std::endl;
+    }
+
+    return static_cast<GLboolean>(status);
+  }
+
+  // プログラムオブジェクトを作成する
+  //   vsrc: バーテックスシェーダのソースプログラムの文字列
+  //   fsrc: フラグメントシェーダのソースプログラムの文字列
+  static GLuint createProgram(const char *vsrc, const char *fsrc)
+  {
+    // 空のプログラムオブジェクトを作成する
+    const GLuint program(glCreateProgram());
+
+    if (vsrc != NULL)
+    {
+      // バーテックスシェーダのシェーダオブジェクトを作成する
+      const GLuint vobj(glCreateShader(GL_VERTEX_SHADER));
+      glShaderSource(vobj, 1, &vsrc, NULL);
+      glCompileShader(vobj);
+
+      // バーテックスシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+      if (printShaderInfoLog(vobj, "vertex shader"))
+        glAttachShader(program, vobj);
+      glDeleteShader(vobj);
+    }
+
+    if (fsrc != NULL)
+    {
+      // フラグメントシェーダのシェーダオブジェクトを作成する
+      const GLuint fobj(glCreateShader(GL_FRAGMENT_SHADER));
+      glShaderSource(fobj, 1, &fsrc, NULL);
+      glCompileShader(fobj);
+
+      // フラグメントシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
+      if (printShaderInfoLog(fobj, "fragment shader"))
+        glAttachShader(program, fobj);
+      glDeleteShader(fobj);
+    }
+
+    // プログラムオブジェクトをリンクする
+    link(program);
+
+    // 作成したプログラムオブジェクトを返す
+    if (printProgramInfoLog(program))
+      return program;
+
+    // プログラムオブジェクトが作成できなければ 0 を返す
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  // attribute 変数と出力変数の場所を決めてプログラムオブジェクトをリンクする
+  //   program: プログラムオブジェクト名
+  static void link(GLuint program)
+  {
+    glBindAttribLocation(program, 0, "position");
+    glBindAttribLocation(program, 1, "normal");
+    glBindAttribLocation(program, 2, "materialId");
+    glBindFragDataLocation(program, 0, "fragment");
+
+    // リンクしたバイナリを取り出せるようにする
+    if (ProgramCache::get().isSupported())
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+  }
+
+  // プログラムオブジェクトの作成を始める (コンパイルとリンクの結果は待たない)
+  //   vsrc: バーテックスシェーダのソースプログラムの文字列
+  //   fsrc: フラグメントシェーダのソースプログラムの文字列
+  static GLuint beginProgram(const char *vsrc, const char *fsrc)
+  {
+    const GLuint program(glCreateProgram());
+    static const GLenum type[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const char *const src[] = { vsrc, fsrc };
+    for (int i = 0; i < 2; ++i)
+    {
+      // 組み込んだシェーダオブジェクトはプログラムオブジェクトと一緒に削除される
+      const GLuint shader(glCreateShader(type[i]));
+      glShaderSource(shader, 1, &src[i], NULL);
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+      glDeleteShader(shader);
+    }
+    link(program);
+    return program;
+  }
+
+  // beginProgram() で始めたプログラムオブジェクトの作成の結果を調べる
+  //   program: プログラムオブジェクト名
+  //   戻り値: リンクに成功していれば true
+  static bool finishProgram(GLuint program)
+  {
+    // リンクに失敗していたらシェーダのコンパイル結果も表示する
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+      GLuint shader[2];
+      GLsizei count;
+      glGetAttachedShaders(program, 2, &count, shader);
+      for (GLsizei i = 0; i < count; ++i)
+        printShaderInfoLog(shader[i], i == 0 ? "vertex shader" : "fragment shader");
+    }
+
+    return printProgramInfoLog(program) != GL_FALSE;
+  }
+
+  // シェーダのソースファイルを前処理してプログラムオブジェクトを作成する
+  GLuint load()
+  {
+    // シェーダのソースファイルを読み込んで #include と #define を展開する
+    const ShaderSource vsrc(vert.c_str(), defines), fsrc(frag.c_str(), defines);
+    if (!vsrc || !fsrc) return 0;
+    depend(vsrc, fsrc);
+
+    // 前の起動で保存したバイナリがあればコンパイルせずに使う
+    ProgramCache &cache(ProgramCache::get());
+    key = cache.key(vsrc.get(), fsrc.get(), defines);
+    GLuint program(cache.load(key));
+    if (program != 0) return program;
+
+    // なければ (あっても使えなければ) コンパイルしてバイナリを保存する
+    program = createProgram(vsrc.get(), fsrc.get());
+    cache.store(key, program);
+    return program;
+  }
+
+  // 読み込んだソースファイルを覚えておく
+  //   vsrc: バーテックスシェーダのソースプログラム
+  //   fsrc: フラグメントシェーダのソースプログラム
+  void depend(const ShaderSource &vsrc, const ShaderSource &fsrc)
+  {
+    files = vsrc.getFiles();
+    for (const std::string &f : fsrc.getFiles())
+      if (std::find(files.begin(), files.end(), f) == files.end()) files.emplace_back(f);
+  }
+
+  // uniform 変数の型から一要素のバイト数を求める
+  //   type: uniform 変数の型
+  static GLsizei bytes(GLenum type)
+  {
+    switch (type)
+    {
+    case GL_FLOAT_VEC2:
+    case GL_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_BOOL_VEC2:
+      return 8;
+    case GL_FLOAT_VEC3:
+    case GL_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_BOOL_VEC3:
+      return 12;
+    case GL_FLOAT_VEC4:
+    case GL_INT_VEC4:
+    case GL_UNSIGNED_INT_VEC4:
+    case GL_BOOL_VEC4:
+    case GL_FLOAT_MAT2:
+      return 16;
+    case GL_FLOAT_MAT2x3:
+    case GL_FLOAT_MAT3x2:
+      return 24;
+    case GL_FLOAT_MAT2x4:
+    case GL_FLOAT_MAT4x2:
+      return 32;
+    case GL_FLOAT_MAT3:
+      return 36;
+    case GL_FLOAT_MAT3x4:
+    case GL_FLOAT_MAT4x3:
+      return 48;
+    case GL_FLOAT_MAT4:
+      return 64;
+    default:
+      // float, int, unsigned int, bool とサンプラ
+      return 4;
+    }
+  }
+
+  // アクティブな uniform 変数と uniform ブロックと attribute 変数を調べる
+  void reflect()
+  {
+    GLint count, length;
+    std::vector<GLchar> name;
+
+    // uniform ブロックに含まれない uniform 変数
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+    name.resize(length + 1);
+    for (GLuint i = 0; i < static_cast<GLuint>(count); ++i)
+    {
+      GLint blockIndex;
+      glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+      if (blockIndex >= 0) continue;
+
+      Variable v;
+      glGetActiveUniform(program, i, length + 1, NULL, &v.size, &v.type, name.data());
+      v.location = glGetUniformLocation(program, name.data());
+      v.name = name.data();
+      const std::string::size_type bracket(v.name.find('['));
+      if (bracket != std::string::npos) v.name.erase(bracket);
+      v.cache = value.size();
+      v.bytes = bytes(v.type);
+      v.sent = false;
+      value.resize(value.size() + v.bytes * v.size);
+      variable.emplace_back(v);
+    }
+
+    // uniform ブロック
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &length);
+    name.resize(length + 1);
+    for (GLuint i = 0; i < static_cast<GLuint>(count); ++i)
+    {
+      Block b;
+      glGetActiveUniformBlockName(program, i, length + 1, NULL, name.data());
+      glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &b.size);
+      b.name = name.data();
+      b.index = i;
+      block.emplace_back(b);
+    }
+
+    // attribute 変数
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &length);
+    name.resize(length + 1);
+    for (GLuint i = 0; i < static_cast<GLuint>(count); ++i)
+    {
+      Attribute a;
+      GLint size;
+      glGetActiveAttrib(program, i, length + 1, NULL, &size, &a.type, name.data());
+      a.location = glGetAttribLocation(program, name.data());
+      a.name = name.data();
+      attribute.emplace_back(a);
+    }
+  }
+
+  // 値が変わっていれば uniform 変数に送る
+  //   u: uniform 変数の番号
+  //   data: 送る値
+  //   count: 送る要素数
+  //   戻り値: 送る必要があれば true
+  bool changed(int u, const void *data, GLsizei count)
+  {
+    Variable &v(variable[u]);
+    char *const cache(value.data() + v.cache);
+    const std::size_t n(v.bytes * std::min(count, v.size));
+
+    // 前に送った値と同じなら送らない
+    if (v.sent && std::memcmp(cache, data, n) == 0)
+    {
+      ++stats().elided;
+      return false;
+    }
+
+    std::memcpy(cache, data, n);
+    v.sent = true;
+    ++stats().issued;
+    return true;
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 送った uniform 変数の数
+    unsigned long long issued;
+
+    // 値が変わらないので省略した uniform 変数の数
+    unsigned long long elided;
+
+    // 作り直して入れ替えた回数
+    unsigned long long reloads;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   vert: バーテックスシェーダのソースファイル名
+  //   frag: フラグメントシェーダのソースファイル名
+  //   defines: ソースファイルの #version の直後に差し込む #define の並び
+  Program(const char *vert, const char *frag, const std::string &defines = "")
+    : program(0)
+    , vert(vert != NULL ? vert : ""), frag(frag != NULL ? frag : ""), defines(defines)
+    , key(0), pending(0), pendingKey(0)
+  {
+    program = load();
+    if (program != 0) reflect();
+  }
+
+  // デストラクタ
+  ~Program()
+  {
+    if (pending != 0) glDeleteProgram(pending);
+    State::get().forgetProgram(program);
+    glDeleteProgram(program);
+  }
+
+  // シェーダのソースファイルを読み込み直してプログラムオブジェクトの作り直しを始める
+  // (描画を止めないように結果は待たず、出来上がったら update() で入れ替える)
+  //   戻り値: ソースファイルが読めなければ false
+  bool reload()
+  {
+    const ShaderSource vsrc(vert.c_str(), defines), fsrc(frag.c_str(), defines);
+    if (!vsrc || !fsrc) return false;
+    depend(vsrc, fsrc);
+
+    // ドライバが使えるだけのスレッドでコンパイルしてもらう
+    if (GLEW_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    // 作り直している途中のものは捨てる
+    if (pending != 0) glDeleteProgram(pending);
+    pendingKey = ProgramCache::key(vsrc.get(), fsrc.get(), defines);
+    pending = beginProgram(vsrc.get(), fsrc.get());
+    return true;
+  }
+
+  // 作り直したプログラムオブジェクトが出来上がっていれば入れ替える (毎フレーム呼び出す)
+  // (KHR_parallel_shader_compile がなければ最初の呼び出しでリンクの完了を待つ)
+  //   戻り値: 入れ替えたら true (uniform 変数の番号などは取り出し直す)
+  bool update()
+  {
+    if (pending == 0) return false;
+
+    // リンクが終わっていなければ今のプログラムオブジェクトを使い続ける
+    if (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile)
+    {
+      GLint completed;
+      glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &completed);
+      if (completed == GL_FALSE) return false;
+    }
+
+    // 失敗していたら捨てて今のプログラムオブジェクトを使い続ける
+    const GLuint next(pending);
+    pending = 0;
+    if (!finishProgram(next))
+    {
+      glDeleteProgram(next);
+      return false;
+    }
+    // 新しいバイナリを保存して書き換える前のソースプログラムのバイナリは消す
+    ProgramCache &cache(ProgramCache::get());
+    cache.store(pendingKey, next);
+    if (pendingKey != key) cache.discard(key);
+    key = pendingKey;
+
+    // 入れ替えて調べ直す
+    State::get().forgetProgram(program);
+    glDeleteProgram(program);
+    program = next;
+    variable.clear();
+    block.clear();
+    attribute.clear();
+    value.clear();
+    reflect();
+    ++stats().reloads;
+    return true;
+  }
+
+  // 読み込んだソースファイル名を取り出す (#include したファイルを含む)
+  const std::vector<std::string> &getFiles() const
+  {
+    return files;
+  }
+
+  // プログラムオブジェクト名を取り出す
+  GLuint get() const
+  {
+    return program;
+  }
+
+  // このプログラムオブジェクトを使用する
+  void use() const
+  {
+    State::get().useProgram(program);
+  }
+
+  // uniform 変数の番号を取り出す (見つからなければ -1)
+  //   name: uniform 変数名
+  int uniform(const char *name) const
+  {
+    for (std::size_t i = 0; i < variable.size(); ++i)
+      if (variable[i].name == name) return static_cast<int>(i);
+    return -1;
+  }
+
+  // attribute 変数の場所を取り出す (見つからなければ -1)
+  //   name: attribute 変数名
+  GLint attrib(const char *name) const
+  {
+    for (const Attribute &a : attribute)
+      if (a.name == name) return a.location;
+    return -1;
+  }
+
+  // uniform ブロックを結合ポイントに結びつける (見つからなければ false)
+  //   name: uniform ブロック名
+  //   bp: 結合ポイント
+  bool bindBlock(const char *name, GLuint bp) const
+  {
+    for (const Block &b : block)
+    {
+      if (b.name == name)
+      {
+        glUniformBlockBinding(program, b.index, bp);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // uniform 変数に float 型の値を設定する (使用中のプログラムオブジェクトでなければならない)
+  //   u: uniform 変数の番号
+  //   data: 設定する値
+  //   count: 設定する要素数
+  void set(int u, const GLfloat *data, GLsizei count = 1)
+  {
+    if (u < 0 || !changed(u, data, count)) return;
+
+    const Variable &v(variable[u]);
+    switch (v.type)
+    {
+    case GL_FLOAT:
+      glUniform1fv(v.location, count, data);
+      break;
+    case GL_FLOAT_VEC2:
+      glUniform2fv(v.location, count, data);
+      break;
+    case GL_FLOAT_VEC3:
+      glUniform3fv(v.location, count, data);
+      break;
+    case GL_FLOAT_VEC4:
+      glUniform4fv(v.location, count, data);
+      break;
+    case GL_FLOAT_MAT2:
+      glUniformMatrix2fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT3:
+      glUniformMatrix3fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT4:
+      glUniformMatrix4fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT2x3:
+      glUniformMatrix2x3fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT3x2:
+      glUniformMatrix3x2fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT2x4:
+      glUniformMatrix2x4fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT4x2:
+      glUniformMatrix4x2fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT3x4:
+      glUniformMatrix3x4fv(v.location, count, GL_FALSE, data);
+      break;
+    case GL_FLOAT_MAT4x3:
+      glUniformMatrix4x3fv(v.location, count, GL_FALSE, data);
+      break;
+    default:
+      std::cerr << "Error: " << v.name << " is not a float uniform" << std::endl;
+      break;
+    }
+  }
+
+  // uniform 変数に int 型の値を設定する (使用中のプログラムオブジェクトでなければならない)
+  // (unsigned int と bool の uniform 変数にも同じビット列の値を設定する)
+  //   u: uniform 変数の番号
+  //   data: 設定する値
+  //   count: 設定する要素数
+  void set(int u, const GLint *data, GLsizei count = 1)
+  {
+    if (u < 0 || !changed(u, data, count)) return;
+
+    const Variable &v(variable[u]);
+    switch (v.type)
+    {
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:
+      glUniform2iv(v.location, count, data);
+      break;
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:
+      glUniform3iv(v.location, count, data);
+      break;
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:
+      glUniform4iv(v.location, count, data);
+      break;
+    case GL_UNSIGNED_INT:
+      glUniform1uiv(v.location, count, reinterpret_cast<const GLuint *>(data));
+      break;
+    case GL_UNSIGNED_INT_VEC2:
+      glUniform2uiv(v.location, count, reinterpret_cast<const GLuint *>(data));
+      break;
+    case GL_UNSIGNED_INT_VEC3:
+      glUniform3uiv(v.location, count, reinterpret_cast<const GLuint *>(data));
+      break;
+    case GL_UNSIGNED_INT_VEC4:
+      glUniform4uiv(v.location, count, reinterpret_cast<const GLuint *>(data));
+      break;
+    case GL_FLOAT:
+    case GL_FLOAT_VEC2:
+    case GL_FLOAT_VEC3:
+    case GL_FLOAT_VEC4:
+    case GL_FLOAT_MAT2:
+    case GL_FLOAT_MAT3:
+    case GL_FLOAT_MAT4:
+    case GL_FLOAT_MAT2x3:
+    case GL_FLOAT_MAT3x2:
+    case GL_FLOAT_MAT2x4:
+    case GL_FLOAT_MAT4x2:
+    case GL_FLOAT_MAT3x4:
+    case GL_FLOAT_MAT4x3:
+      std::cerr << "Error: " << v.name << " is not an int uniform" << std::endl;
+      break;
+    default:
+      // int, bool とサンプラ
+      glUniform1iv(v.location, count, data);
+      break;
+    }
+  }
+};
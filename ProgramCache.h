@@ -0,0 +1,247 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <GL/glew.h>
+
+// ハッシュ関数
+#include "Hash.h"
+
+//
+// リンクしたプログラムオブジェクトのバイナリをファイルに保存して次回の起動で使う
+//
+// シェーダのソースプログラムと #define の並びとドライバの名前と版数のハッシュ値を
+// キーにしてファイル名を決める。読み込んだバイナリをドライバが受け付けなければ
+// 呼び出し側でコンパイルし直して保存し直す
+//
+class ProgramCache
+{
+  // ファイルの先頭に置く情報
+  struct Header
+  {
+    // ファイルの識別子
+    char magic[4];
+
+    // ファイルの形式の版数
+    std::uint32_t version;
+
+    // キー
+    std::uint64_t key;
+
+    // バイナリの形式
+    GLenum format;
+
+    // バイナリのサイズ
+    std::uint32_t length;
+  };
+
+  // ファイルの形式の版数
+  static constexpr std::uint32_t version = 1;
+
+  // 保存するファイル名の先頭
+  const std::string prefix;
+
+  // ドライバがプログラムオブジェクトのバイナリを扱えれば true
+  const bool supported;
+
+  // コピーコンストラクタによるコピー禁止
+  ProgramCache(const ProgramCache &c);
+
+  // 代入によるコピー禁止
+  ProgramCache &operator=(const ProgramCache &c);
+
+  // ドライバがプログラムオブジェクトのバイナリを扱えるか調べる
+  static bool probe()
+  {
+    if (!GLEW_ARB_get_program_binary) return false;
+    GLint formats(0);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+  }
+
+  // キーからファイル名を求める
+  //   key: キー
+  std::string path(std::uint64_t key) const
+  {
+    char hex[17];
+    std::snprintf(hex, sizeof hex, "%016llx", static_cast<unsigned long long>(key));
+    return prefix + hex + ".bin";
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 保存したバイナリを使った数
+    unsigned long long hits;
+
+    // 保存したバイナリがなかった数
+    unsigned long long misses;
+
+    // 保存したバイナリをドライバが受け付けなかった数
+    unsigned long long rejected;
+
+    // 保存したバイナリの数
+    unsigned long long stored;
+  };
+
+  // コンストラクタ (OpenGL のコンテキストを作ってから呼び出す)
+  //   prefix: 保存するファイル名の先頭
+  ProgramCache(const char *prefix = "program-")
+    : prefix(prefix), supported(probe())
+  {
+  }
+
+  // 全体で使うキャッシュを取り出す
+  static ProgramCache &get()
+  {
+    static ProgramCache instance;
+    return instance;
+  }
+
+  // ドライバがプログラムオブジェクトのバイナリを扱えれば true
+  bool isSupported() const
+  {
+    return supported;
+  }
+
+  // キーを求める
+  //   vsrc: バーテックスシェーダのソースプログラムの文字列
+  //   fsrc: フラグメントシェーダのソースプログラムの文字列
+  //   defines: ソースプログラムに加えた #define の並び
+  static std::uint64_t key(const char *vsrc, const char *fsrc, const std::string &defines = "")
+  {
+    std::uint64_t h(Hash::compute(vsrc, std::strlen(vsrc)));
+    h = Hash::compute(fsrc, std::strlen(fsrc), h);
+    h = Hash::compute(defines.data(), defines.size(), h);
+
+    // ドライバが変わったら使わない
+    static const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    for (GLenum name : names)
+    {
+      const char *const s(reinterpret_cast<const char *>(glGetString(name)));
+      if (s != NULL) h = Hash::compute(s, std::strlen(s), h);
+    }
+
+    return h;
+  }
+
+  // 保存したバイナリからプログラムオブジェクトを作る
+  //   key: キー
+  //   戻り値: 作成したプログラムオブジェクト名 (使えなければ 0)
+  GLuint load(std::uint64_t key) const
+  {
+    if (!supported) return 0;
+
+    // 保存したファイルを開く
+    std::ifstream file(path(key).c_str(), std::ios::binary);
+    Header header;
+    if (file.fail() || !file.read(reinterpret_cast<char *>(&header), sizeof header)
+      || std::memcmp(header.magic, "GLPB", 4) != 0
+      || header.version != version || header.key != key)
+    {
+      ++stats().misses;
+      return 0;
+    }
+
+    // バイナリのサイズがファイルの残りと合わなければ壊れているので使わない
+    file.seekg(0, std::ios::end);
+    const std::streamoff rest(static_cast<std::streamoff>(file.tellg())
+      - static_cast<std::streamoff>(sizeof header));
+    if (rest != static_cast<std::streamoff>(header.length))
+    {
+      ++stats().misses;
+      return 0;
+    }
+    file.seekg(sizeof header, std::ios::beg);
+
+    // バイナリを読み込む
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length))
+    {
+      ++stats().misses;
+      return 0;
+    }
+
+    // ドライバに渡してリンクできたか調べる
+    const GLuint program(glCreateProgram());
+    glProgramBinary(program, header.format, binary.data(), header.length);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+      glDeleteProgram(program);
+      ++stats().rejected;
+      return 0;
+    }
+
+    ++stats().hits;
+    return program;
+  }
+
+  // リンクしたプログラムオブジェクトのバイナリを保存する
+  //   key: キー
+  //   program: プログラムオブジェクト名 (GL_PROGRAM_BINARY_RETRIEVABLE_HINT を設定してリンクしたもの)
+  void store(std::uint64_t key, GLuint program) const
+  {
+    if (!supported || program == 0) return;
+
+    // バイナリを取り出す
+    GLint length(0);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    Header header = { { 'G', 'L', 'P', 'B' }, version, key, 0, 0 };
+    GLsizei written(0);
+    glGetProgramBinary(program, length, &written, &header.format, binary.data());
+    if (written <= 0) return;
+    header.length = static_cast<std::uint32_t>(written);
+
+    // 書き込みの途中で止まっても壊れたファイルが残らないように別名で書いてから置き換える
+    const std::string name(path(key)), temporary(name + ".tmp");
+    {
+      std::ofstream file(temporary.c_str(), std::ios::binary);
+      if (file.fail()
+        || !file.write(reinterpret_cast<const char *>(&header), sizeof header)
+        || !file.write(binary.data(), written)
+        || !file.flush())
+      {
+        std::cerr << "Warning: Can't write program binary: " << temporary << std::endl;
+        file.close();
+        std::remove(temporary.c_str());
+        return;
+      }
+    }
+#if defined(_WIN32)
+    // Windows の rename() は既存のファイルを置き換えない
+    std::remove(name.c_str());
+#endif
+    if (std::rename(temporary.c_str(), name.c_str()) != 0)
+    {
+      std::cerr << "Warning: Can't replace program binary: " << name << std::endl;
+      std::remove(temporary.c_str());
+      return;
+    }
+
+    ++stats().stored;
+  }
+
+  // 保存したバイナリを削除する (使わなくなったキーのもの)
+  //   key: キー
+  void discard(std::uint64_t key) const
+  {
+    if (supported) std::remove(path(key).c_str());
+  }
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
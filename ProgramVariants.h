@@ -0,0 +1,124 @@
+﻿#pragma once
+#include <map>
+#include <string>
+#include <memory>
+#include <functional>
+
+// プログラムオブジェクト
+#include "Program.h"
+
+//
+// 組み合わせごとに特殊化したプログラムオブジェクト
+//
+// 同じシェーダのソースファイルに組み合わせを表す #define を差し込んだものを
+// 初めて使うときにコンパイルし、組み合わせのビットマスクをキーにして取っておく
+//
+class ProgramVariants
+{
+  // シェーダのソースファイル名
+  const std::string vert, frag;
+
+  // 作成したプログラムオブジェクトに一度だけ行う設定
+  const std::function<void(Program &)> setup;
+
+  // 組み合わせごとのプログラムオブジェクト
+  std::map<unsigned int, std::unique_ptr<Program>> variant;
+
+  // コピーコンストラクタによるコピー禁止
+  ProgramVariants(const ProgramVariants &v);
+
+  // 代入によるコピー禁止
+  ProgramVariants &operator=(const ProgramVariants &v);
+
+public:
+
+  // 組み合わせのビット
+  enum : unsigned int
+  {
+    // 頂点ごとに材質の番号を持つ頂点の形式 (VERTEX_MATERIAL)
+    VertexMaterial = 1u << 0,
+
+    // クラスタごとに選んだ光源で陰影を付ける (CLUSTERED)
+    Clustered = 1u << 1
+  };
+
+  // クラスタを使わないときの光源の数を置くビットの位置
+  static constexpr unsigned int lightShift = 8;
+
+  // クラスタを使わないときの光源の数を組み合わせのビットにする
+  //   count: 光源の数
+  static constexpr unsigned int lights(unsigned int count)
+  {
+    return count << lightShift;
+  }
+
+  // 統計
+  struct Stats
+  {
+    // 作成したプログラムオブジェクトの数
+    unsigned long long compiled;
+
+    // 取り出した回数
+    unsigned long long lookups;
+  };
+
+  // 組み合わせに対応する #define の並びを求める
+  //   key: 組み合わせのビットマスク
+  static std::string defines(unsigned int key)
+  {
+    std::string d;
+    if (key & VertexMaterial) d += "#define VERTEX_MATERIAL 1\n";
+    if (key & Clustered) d += "#define CLUSTERED 1\n";
+    if (key >> lightShift) d += "#define LIGHT_COUNT " + std::to_string(key >> lightShift) + "\n";
+    return d;
+  }
+
+  // コンストラクタ
+  //   vert: バーテックスシェーダのソースファイル名
+  //   frag: フラグメントシェーダのソースファイル名
+  //   setup: プログラムオブジェクトを作成したり作り直したりしたときに行う設定
+  ProgramVariants(const char *vert, const char *frag, std::function<void(Program &)> setup)
+    : vert(vert), frag(frag), setup(std::move(setup))
+  {
+  }
+
+  // 組み合わせに対応するプログラムオブジェクトを取り出す (なければ作成する)
+  //   key: 組み合わせのビットマスク
+  Program &get(unsigned int key)
+  {
+    ++stats().lookups;
+    std::unique_ptr<Program> &p(variant[key]);
+    if (!p)
+    {
+      p.reset(new Program(vert.c_str(), frag.c_str(), defines(key)));
+      if (p->get() != 0) setup(*p);
+      ++stats().compiled;
+    }
+    return *p;
+  }
+
+  // 作成したプログラムオブジェクトの数を取り出す
+  std::size_t size() const
+  {
+    return variant.size();
+  }
+
+  // 作成した全てのプログラムオブジェクトの作り直しを始める
+  void reload()
+  {
+    for (auto &v : variant) v.second->reload();
+  }
+
+  // 作り直したプログラムオブジェクトが出来上がっていれば入れ替えて設定し直す
+  void update()
+  {
+    for (auto &v : variant) if (v.second->update()) setup(*v.second);
+  }
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
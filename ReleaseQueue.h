@@ -0,0 +1,211 @@
+﻿#pragma once
+#include <map>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <GL/glew.h>
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// GPU の処理が終わるまで資源の削除を遅らせる待ち行列
+//
+class ReleaseQueue
+{
+  // 削除を待つバッファオブジェクト
+  struct Buffer
+  {
+    // バッファオブジェクト名
+    GLuint name;
+
+    // 確保したサイズ
+    GLsizeiptr size;
+
+    // 確保したときの使い方
+    GLenum usage;
+  };
+
+  // 一フレームの間に削除を要求された資源
+  struct Batch
+  {
+    // このフレームの描画命令の完了を待つ同期オブジェクト
+    GLsync fence;
+
+    // 頂点配列オブジェクト名
+    std::vector<GLuint> vao;
+
+    // バッファオブジェクト
+    std::vector<Buffer> buffer;
+  };
+
+  // 今のフレームで削除を要求された資源
+  Batch current;
+
+  // 同期オブジェクトの完了を待っている資源
+  std::deque<Batch> pending;
+
+  // 再利用に備えて取っておくバッファオブジェクト (サイズと使い方で引く)
+  std::multimap<std::pair<GLsizeiptr, GLenum>, GLuint> spare;
+
+  // 取っておくバッファオブジェクトの合計サイズとその上限
+  GLsizeiptr spareBytes, spareLimit;
+
+  // 再利用したバッファオブジェクトの数と削除したバッファオブジェクトの数
+  unsigned long long recycled, deleted;
+
+  // コンストラクタ
+  ReleaseQueue()
+    : current{}, spareBytes(0), spareLimit(64 * 1024 * 1024)
+    , recycled(0), deleted(0)
+  {
+  }
+
+  // コピーコンストラクタによるコピー禁止
+  ReleaseQueue(const ReleaseQueue &q);
+
+  // 代入によるコピー禁止
+  ReleaseQueue &operator=(const ReleaseQueue &q);
+
+  // GPU が使い終わった資源を片付ける
+  //   batch: 片付ける資源
+  void retire(Batch &batch)
+  {
+    // 頂点配列オブジェクトは削除する
+    for (GLuint vao : batch.vao) State::get().forgetVertexArray(vao);
+    if (!batch.vao.empty())
+      glDeleteVertexArrays(static_cast<GLsizei>(batch.vao.size()), batch.vao.data());
+
+    // バッファオブジェクトは上限まで再利用に備えて取っておく (使い方が 0 なら取っておかない)
+    for (const Buffer &b : batch.buffer)
+    {
+      if (b.usage != 0 && spareBytes + b.size <= spareLimit)
+      {
+        spare.emplace(std::make_pair(b.size, b.usage), b.name);
+        spareBytes += b.size;
+      }
+      else
+      {
+        State::get().forgetBuffer(b.name);
+        glDeleteBuffers(1, &b.name);
+        ++deleted;
+      }
+    }
+
+    if (batch.fence) glDeleteSync(batch.fence);
+  }
+
+public:
+
+  // 待ち行列を取り出す (終了時の破棄の順序に左右されないように解放しない)
+  static ReleaseQueue &get()
+  {
+    static ReleaseQueue *const instance(new ReleaseQueue);
+    return *instance;
+  }
+
+  // バッファオブジェクトを作成する (同じサイズのものが空いていれば再利用する)
+  //   target: 結合するターゲット
+  //   size: 確保するサイズ
+  //   data: 格納するデータ (NULL なら格納しない)
+  //   usage: バッファオブジェクトの使い方
+  GLuint createBuffer(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+  {
+    const auto s(spare.find(std::make_pair(size, usage)));
+    if (s != spare.end())
+    {
+      // 空いているバッファオブジェクトの領域にデータを上書きする
+      const GLuint name(s->second);
+      spare.erase(s);
+      spareBytes -= size;
+      ++recycled;
+
+      State::get().bindBuffer(target, name);
+      if (data != NULL) glBufferSubData(target, 0, size, data);
+      return name;
+    }
+
+    // 新しいバッファオブジェクトを作る
+    GLuint name;
+    glGenBuffers(1, &name);
+    State::get().bindBuffer(target, name);
+    glBufferData(target, size, data, usage);
+    return name;
+  }
+
+  // バッファオブジェクトの削除を要求する
+  //   name: バッファオブジェクト名
+  //   size: 確保したサイズ
+  //   usage: 確保したときの使い方 (再利用できない場合は 0)
+  void deleteBuffer(GLuint name, GLsizeiptr size, GLenum usage)
+  {
+    if (name == 0) return;
+    const Buffer b = { name, size, usage };
+    current.buffer.emplace_back(b);
+  }
+
+  // 頂点配列オブジェクトの削除を要求する
+  //   name: 頂点配列オブジェクト名
+  void deleteVertexArray(GLuint name)
+  {
+    if (name != 0) current.vao.emplace_back(name);
+  }
+
+  // フレームの終わりに呼び出す
+  void frame()
+  {
+    // このフレームで削除を要求された資源をこのフレームの描画の完了まで待たせる
+    if (!current.vao.empty() || !current.buffer.empty())
+    {
+      current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      pending.emplace_back(std::move(current));
+      current = Batch{};
+    }
+
+    // 描画が完了したフレームの資源を古い順に片付ける
+    while (!pending.empty())
+    {
+      const GLenum status(glClientWaitSync(pending.front().fence, 0, 0));
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+      retire(pending.front());
+      pending.pop_front();
+    }
+  }
+
+  // 全ての資源を削除する (コンテキストを破棄する前に呼び出す)
+  void flush()
+  {
+    // GPU の処理の完了を待つ
+    glFinish();
+
+    // 再利用に備えずに全て削除する
+    const GLsizeiptr limit(spareLimit);
+    spareLimit = 0;
+    pending.emplace_back(std::move(current));
+    current = Batch{};
+    for (Batch &b : pending) retire(b);
+    pending.clear();
+    spareLimit = limit;
+
+    for (const auto &s : spare)
+    {
+      State::get().forgetBuffer(s.second);
+      glDeleteBuffers(1, &s.second);
+      ++deleted;
+    }
+    spare.clear();
+    spareBytes = 0;
+  }
+
+  // 再利用したバッファオブジェクトの数を取り出す
+  unsigned long long getRecycledCount() const
+  {
+    return recycled;
+  }
+
+  // 削除したバッファオブジェクトの数を取り出す
+  unsigned long long getDeletedCount() const
+  {
+    return deleted;
+  }
+};
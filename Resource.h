@@ -0,0 +1,250 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+// 資源の検証を行うかどうか (デバッグビルドでは検証する)
+#ifndef RESOURCE_VALIDATION
+#  ifdef NDEBUG
+#    define RESOURCE_VALIDATION 0
+#  else
+#    define RESOURCE_VALIDATION 1
+#  endif
+#endif
+
+//
+// 世代付きのハンドル
+//
+template <typename T>
+class Handle
+{
+  // 下位 20 ビットが格納場所の番号, 上位 12 ビットが世代 (0 は無効なハンドル)
+  std::uint32_t id;
+
+public:
+
+  // 格納場所の番号のビット数
+  static constexpr int indexBits = 20;
+
+  // 格納場所の番号のマスク
+  static constexpr std::uint32_t indexMask = (1u << indexBits) - 1;
+
+  // 世代の最大値
+  static constexpr std::uint32_t generationMax = ~0u >> indexBits;
+
+  // コンストラクタ
+  //   id: ハンドルの値
+  explicit Handle(std::uint32_t id = 0)
+    : id(id)
+  {
+  }
+
+  // 格納場所の番号と世代からハンドルを作るコンストラクタ
+  //   index: 格納場所の番号
+  //   generation: 世代
+  Handle(std::uint32_t index, std::uint32_t generation)
+    : id(generation << indexBits | index)
+  {
+  }
+
+  // ハンドルの値を取り出す
+  std::uint32_t get() const
+  {
+    return id;
+  }
+
+  // 格納場所の番号を取り出す
+  std::uint32_t index() const
+  {
+    return id & indexMask;
+  }
+
+  // 世代を取り出す
+  std::uint32_t generation() const
+  {
+    return id >> indexBits;
+  }
+
+  // 無効なハンドルでなければ true
+  explicit operator bool() const
+  {
+    return id != 0;
+  }
+
+  // 比較
+  bool operator==(const Handle &h) const
+  {
+    return id == h.id;
+  }
+  bool operator!=(const Handle &h) const
+  {
+    return id != h.id;
+  }
+};
+
+//
+// 資源を連続した領域に格納するプール
+//
+template <typename T>
+class Resource
+{
+  // 格納場所
+  struct Slot
+  {
+    // 資源の密な配列上の位置
+    std::uint32_t dense;
+
+    // 世代
+    std::uint32_t generation;
+  };
+
+  // 資源の密な配列
+  std::vector<T> dense;
+
+  // 密な配列の要素に対応する格納場所の番号
+  std::vector<std::uint32_t> owner;
+
+  // 格納場所
+  std::vector<Slot> slot;
+
+  // 空いている格納場所の番号
+  std::vector<std::uint32_t> vacant;
+
+  // 無効なハンドルを使ったときの処理
+  //   h: 使ったハンドル
+  //   what: 行おうとした処理
+  static void invalid(Handle<T> h, const char *what)
+  {
+    std::cerr << "Error: Invalid resource handle 0x" << std::hex << h.get()
+      << std::dec << " in " << what << std::endl;
+    abort();
+  }
+
+  // コンストラクタ
+  Resource()
+  {
+  }
+
+  // デストラクタ
+  ~Resource()
+  {
+#if RESOURCE_VALIDATION
+    // 解放されていない資源を報告する
+    if (!dense.empty())
+      std::cerr << "Warning: " << dense.size() << " resources not released" << std::endl;
+#endif
+  }
+
+  // コピーコンストラクタによるコピー禁止
+  Resource(const Resource &r);
+
+  // 代入によるコピー禁止
+  Resource &operator=(const Resource &r);
+
+public:
+
+  // 資源の型ごとのプールを取り出す
+  static Resource &pool()
+  {
+    static Resource instance;
+    return instance;
+  }
+
+  // 資源を作成する
+  //   args: 資源のコンストラクタの引数
+  template <typename... Args>
+  Handle<T> create(Args &&... args)
+  {
+    // 空いている格納場所を使うか新しい格納場所を作る
+    std::uint32_t index;
+    if (vacant.empty())
+    {
+      index = static_cast<std::uint32_t>(slot.size());
+      if (index > Handle<T>::indexMask)
+      {
+        std::cerr << "Error: Too many resources" << std::endl;
+        abort();
+      }
+      const Slot s = { 0, 1 };
+      slot.emplace_back(s);
+    }
+    else
+    {
+      index = vacant.back();
+      vacant.pop_back();
+    }
+
+    // 資源を密な配列の末尾に作る
+    slot[index].dense = static_cast<std::uint32_t>(dense.size());
+    dense.emplace_back(std::forward<Args>(args)...);
+    owner.emplace_back(index);
+
+    return Handle<T>(index, slot[index].generation);
+  }
+
+  // ハンドルが有効なら true
+  //   h: ハンドル
+  bool valid(Handle<T> h) const
+  {
+    return h && h.index() < slot.size()
+      && slot[h.index()].generation == h.generation();
+  }
+
+  // 資源を解放する
+  //   h: 解放する資源のハンドル
+  void release(Handle<T> h)
+  {
+#if RESOURCE_VALIDATION
+    if (!valid(h)) invalid(h, "release");
+#endif
+
+    // 解放する資源の位置に末尾の資源を移して密な配列を保つ
+    Slot &s(slot[h.index()]);
+    if (s.dense + 1 < dense.size())
+    {
+      dense[s.dense] = std::move(dense.back());
+      owner[s.dense] = owner.back();
+      slot[owner.back()].dense = s.dense;
+    }
+    dense.pop_back();
+    owner.pop_back();
+
+    // 世代を進めて古いハンドルを無効にする
+    if (++s.generation > Handle<T>::generationMax) s.generation = 1;
+    vacant.emplace_back(h.index());
+  }
+
+  // 資源を参照する
+  //   h: 資源のハンドル
+  T &operator[](Handle<T> h)
+  {
+#if RESOURCE_VALIDATION
+    if (!valid(h)) invalid(h, "access");
+#endif
+    return dense[slot[h.index()].dense];
+  }
+
+  // 資源を参照する
+  //   h: 資源のハンドル
+  const T &operator[](Handle<T> h) const
+  {
+#if RESOURCE_VALIDATION
+    if (!valid(h)) invalid(h, "access");
+#endif
+    return dense[slot[h.index()].dense];
+  }
+
+  // 資源の数を取り出す
+  std::size_t size() const
+  {
+    return dense.size();
+  }
+
+  // 資源の密な配列を取り出す
+  const T *data() const
+  {
+    return dense.data();
+  }
+};
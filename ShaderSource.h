@@ -0,0 +1,175 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+// メモリに割り当てたファイル
+#include "MappedFile.h"
+
+//
+// シェーダのソースファイルの前処理
+//
+// #include "ファイル名" を読み込んだファイルからの相対パスで展開し、
+// #version の行の直後に #define の並びを差し込む。展開したファイルの区切りには
+// #line を置くので、コンパイルエラーの行番号は元のファイルの行を指す
+// (ファイルの番号は getFiles() の並びの順)
+//
+// ファイルはメモリに割り当てて読み出す。ディスクになければビルド時に実行ファイルに
+// 埋め込んだ同じ名前のソースプログラム (EmbeddedShaders.inc) を使うので、実行ファイル
+// だけで動き、ディスクに置いたファイルは埋め込んだものより優先する
+//
+class ShaderSource
+{
+  // 展開したソースプログラム
+  std::string text;
+
+  // 読み込んだファイル
+  std::vector<std::string> files;
+
+  // #include の入れ子の深さの上限
+  static constexpr int maxDepth = 16;
+
+  // ファイルを展開する
+  //   name: ファイル名
+  //   defines: #version の行の直後に差し込む #define の並び (差し込まなければ NULL)
+  //   depth: #include の入れ子の深さ
+  bool expand(const std::string &name, const std::string *defines, int depth)
+  {
+    if (depth > maxDepth)
+    {
+      std::cerr << "Error: Too deep #include: " << name << std::endl;
+      return false;
+    }
+
+    // ディスクにあればそれを使い、なければ埋め込んだものを使う
+    const MappedFile mapped(name.c_str());
+    const char *source(mapped.get());
+    std::size_t length(mapped.size());
+    if (!mapped && (source = embedded(name.c_str(), length)) == NULL)
+    {
+      std::cerr << "Error: Can't open source file: " << name << std::endl;
+      return false;
+    }
+
+    // このファイルの番号とファイル名を除いたディレクトリ
+    const int index(static_cast<int>(files.size()));
+    files.emplace_back(name);
+    const std::string::size_type slash(name.find_last_of("/\\"));
+    const std::string dir(slash == std::string::npos ? "" : name.substr(0, slash + 1));
+
+    // 展開したファイルの先頭で行番号とファイルの番号を合わせる
+    if (depth > 0) text += "#line 1 " + std::to_string(index) + "\n";
+
+    const char *const last(source + length);
+    const char *begin(source);
+    for (int line = 1; begin < last; ++line)
+    {
+      // 行末の CR は取り除く
+      const char *end(static_cast<const char *>(std::memchr(begin, '\n', last - begin)));
+      if (end == NULL) end = last;
+      const std::string row(begin, end > begin && end[-1] == '\r' ? end - 1 : end);
+      begin = end + 1;
+
+      // 行頭の空白を除いた指令 (# だけの空の指令はそのまま残す)
+      const std::string::size_type first(row.find_first_not_of(" \t"));
+      const std::string::size_type keyword(first != std::string::npos && row[first] == '#'
+        ? row.find_first_not_of(" \t", first + 1) : std::string::npos);
+      const bool directive(keyword != std::string::npos);
+
+      if (directive && row.compare(keyword, 7, "include") == 0)
+      {
+        // ダブルクォートで囲まれたファイル名を取り出して展開する
+        const std::string::size_type open(row.find('"', keyword + 7));
+        const std::string::size_type close(open == std::string::npos ? open : row.find('"', open + 1));
+        if (close == std::string::npos)
+        {
+          std::cerr << "Error: Bad #include in " << name << "(" << line << ")" << std::endl;
+          return false;
+        }
+        if (!expand(dir + row.substr(open + 1, close - open - 1), NULL, depth + 1)) return false;
+
+        // 元のファイルの次の行に戻る
+        text += "#line " + std::to_string(line + 1) + " " + std::to_string(index) + "\n";
+        continue;
+      }
+
+      text += row;
+      text += '\n';
+
+      if (directive && defines != NULL && row.compare(keyword, 7, "version") == 0)
+      {
+        // #version の直後に #define を差し込んで元のファイルの次の行に戻る
+        text += *defines;
+        text += "#line " + std::to_string(line + 1) + " " + std::to_string(index) + "\n";
+        defines = NULL;
+      }
+    }
+
+    return true;
+  }
+
+public:
+
+  // 実行ファイルに埋め込んだソースプログラムを取り出す
+  //   name: ソースファイル名
+  //   length: ソースプログラムの長さ
+  //   戻り値: ソースプログラム (埋め込んでいなければ NULL)
+  static const char *embedded(const char *name, std::size_t &length)
+  {
+    // 埋め込んだソースプログラム
+    struct Embedded
+    {
+      // ソースファイル名
+      const char *name;
+
+      // ソースプログラム
+      const char *source;
+    };
+    static const Embedded table[] =
+    {
+#include "EmbeddedShaders.inc"
+    };
+
+    for (const Embedded &e : table)
+    {
+      if (std::strcmp(e.name, name) == 0)
+      {
+        length = std::strlen(e.source);
+        return e.source;
+      }
+    }
+
+    return NULL;
+  }
+
+  // コンストラクタ
+  //   name: ソースファイル名
+  //   defines: #version の行の直後に差し込む #define の並び
+  ShaderSource(const char *name, const std::string &defines = "")
+  {
+    if (name == NULL || !expand(name, &defines, 0))
+    {
+      text.clear();
+      files.clear();
+    }
+  }
+
+  // 展開できていれば true
+  explicit operator bool() const
+  {
+    return !files.empty();
+  }
+
+  // 展開したソースプログラムを取り出す
+  const char *get() const
+  {
+    return text.c_str();
+  }
+
+  // 読み込んだファイル名を取り出す (#include したファイルを含む)
+  const std::vector<std::string> &getFiles() const
+  {
+    return files;
+  }
+};
@@ -0,0 +1,138 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/stat.h>
+#if defined(__linux__)
+#  include <unistd.h>
+#  include <sys/inotify.h>
+#  define SHADERWATCHER_INOTIFY 1
+#endif
+
+//
+// シェーダのソースファイルの書き換えを見張る
+//
+// Linux では inotify でファイルのあるディレクトリを見張り、書き込みを終えて閉じたときと
+// 別名で保存して置き換えたときに気づく。それ以外や見張りを登録できなかったファイルは
+// ファイルの更新時刻を調べる。どちらも changed() を呼び出したスレッドを止めない
+//
+class ShaderWatcher
+{
+  // 見張るファイル
+  struct File
+  {
+    // パス
+    std::string path;
+
+    // ディレクトリを除いたファイル名
+    std::string name;
+
+    // 見張りの識別子
+    int watch;
+
+    // 最後に調べた更新時刻
+    std::time_t mtime;
+  };
+
+  // 見張るファイル
+  std::vector<File> file;
+
+#if SHADERWATCHER_INOTIFY
+  // inotify のファイル記述子
+  int fd;
+#endif
+
+  // コピーコンストラクタによるコピー禁止
+  ShaderWatcher(const ShaderWatcher &w);
+
+  // 代入によるコピー禁止
+  ShaderWatcher &operator=(const ShaderWatcher &w);
+
+  // ファイルの更新時刻を取り出す (ファイルがなければ 0)
+  //   path: パス
+  static std::time_t modified(const std::string &path)
+  {
+    struct stat s;
+    return stat(path.c_str(), &s) == 0 ? s.st_mtime : 0;
+  }
+
+public:
+
+  // コンストラクタ
+  ShaderWatcher()
+  {
+#if SHADERWATCHER_INOTIFY
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  }
+
+  // デストラクタ
+  ~ShaderWatcher()
+  {
+#if SHADERWATCHER_INOTIFY
+    if (fd >= 0) close(fd);
+#endif
+  }
+
+  // 見張るファイルを追加する
+  //   path: ファイルのパス
+  void add(const char *path)
+  {
+    File f;
+    f.path = path;
+    const std::string::size_type slash(f.path.find_last_of("/\\"));
+    f.name = slash == std::string::npos ? f.path : f.path.substr(slash + 1);
+    f.watch = -1;
+    f.mtime = modified(f.path);
+
+#if SHADERWATCHER_INOTIFY
+    // ファイルを置き換える保存の仕方でも気づくようにディレクトリを見張る
+    if (fd >= 0)
+    {
+      const std::string dir(slash == std::string::npos ? "." : f.path.substr(0, slash));
+      f.watch = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    }
+#endif
+
+    file.emplace_back(f);
+  }
+
+  // 見張っているファイルのどれかが前に調べたときから書き換えられていれば true
+  bool changed()
+  {
+    bool result(false);
+
+#if SHADERWATCHER_INOTIFY
+    if (fd >= 0)
+    {
+      // 溜まっているイベントを全て読み出す
+      alignas(inotify_event) char buffer[4096];
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof buffer)) > 0)
+      {
+        for (char *p = buffer; p < buffer + length; )
+        {
+          const inotify_event *const e(reinterpret_cast<const inotify_event *>(p));
+          for (const File &f : file)
+            if (f.watch >= 0 && e->wd == f.watch && e->len > 0 && f.name == e->name) result = true;
+          p += sizeof (inotify_event) + e->len;
+        }
+      }
+    }
+#endif
+
+    // 見張れなかったファイルは更新時刻が変わっていれば書き換えられている
+    for (File &f : file)
+    {
+      if (f.watch >= 0) continue;
+      const std::time_t t(modified(f.path));
+      if (t != f.mtime)
+      {
+        f.mtime = t;
+        result = true;
+      }
+    }
+
+    return result;
+  }
+};
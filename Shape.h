@@ -1,16 +1,24 @@
 ﻿#pragma once
-#include <memory>
 
 // 図形データ
 #include "Object.h"
 
+// 資源の管理
+#include "Resource.h"
+
+// 描画命令の記録
+#include "CommandBuffer.h"
+
 //
 // 図形の描画
 //
 class Shape
 {
   // 図形データ
-  std::shared_ptr<const Object> object;
+  const Handle<Object> object;
+
+  // 図形データを解放する責任があれば true
+  const bool owner;
 
 protected:
 
@@ -27,25 +35,87 @@ public:
   //   index: 頂点のインデックスを格納した配列
   Shape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
     GLsizei indexcount = 0, const GLuint *index = NULL)
-    : object(new Object(size, vertexcount, vertex, indexcount, index))
+    : object(Resource<Object>::pool().create(size, vertexcount, vertex, indexcount, index))
+    , owner(true)
     , vertexcount(vertexcount)
   {
   }
 
+  // 既存の図形データを使うコンストラクタ (図形データは解放しない)
+  //   object: 図形データのハンドル
+  Shape(Handle<Object> object)
+    : object(object)
+    , owner(false)
+    , vertexcount(Resource<Object>::pool()[object].getVertexCount())
+  {
+  }
+
+  // デストラクタ
+  virtual ~Shape()
+  {
+    // 自分で作った図形データを解放する
+    if (owner) Resource<Object>::pool().release(object);
+  }
+
+private:
+
+  // コピーコンストラクタによるコピー禁止
+  Shape(const Shape &s);
+
+  // 代入によるコピー禁止
+  Shape &operator=(const Shape &s);
+
+public:
+
+  // 図形データのハンドルを取り出す
+  Handle<Object> getObject() const
+  {
+    return object;
+  }
+
   // 描画
   void draw() const
   {
     // 頂点配列オブジェクトを結合する
-    object->bind();
+    Resource<Object>::pool()[object].bind();
+
+    // 描画を実行する
+    execute();
+  }
+
+  // デプスだけの描画 (位置だけを読み出す)
+  void drawDepth() const
+  {
+    // 位置だけを参照する頂点配列オブジェクトを結合する
+    Resource<Object>::pool()[object].bindDepth();
 
     // 描画を実行する
     execute();
   }
 
+  // 描画命令の記録
+  //   commands: 描画命令を記録する先
+  void record(CommandBuffer &commands) const
+  {
+    // 頂点配列オブジェクトの結合を記録する
+    commands.bindVertexArray(Resource<Object>::pool()[object].getVertexArray());
+
+    // 描画の実行を記録する
+    encode(commands);
+  }
+
   // 描画の実行
   virtual void execute() const
   {
     // 折れ線で描画する
     glDrawArrays(GL_LINE_LOOP, 0, vertexcount);
   }
+
+  // 描画の実行の記録
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 折れ線で描画する
+    commands.drawArrays(GL_LINE_LOOP, 0, vertexcount);
+  }
 };
@@ -3,6 +3,9 @@
 // 図形の描画
 #include "Shape.h"
 
+// 頂点の溶接
+#include "Weld.h"
+
 //
 // インデックスを使った図形の描画
 //
@@ -14,6 +17,16 @@ protected:
   // 描画に使う頂点の数
   const GLsizei indexcount;
 
+  // 溶接した頂点を使うコンストラクタ
+  //   size: 頂点の位置の次元
+  //   weld: 溶接した頂点属性とインデックス
+  ShapeIndex(GLint size, const Weld &weld)
+    : Shape(size, weld.getVertexCount(), weld.getVertex(),
+      weld.getIndexCount(), weld.getIndex())
+    , indexcount(weld.getIndexCount())
+  {
+  }
+
 public:
 
   // コンストラクタ
@@ -24,8 +37,15 @@ public:
   //   index: 頂点のインデックスを格納した配列
   ShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
     GLsizei indexcount, const GLuint *index)
-    : Shape(size, vertexcount, vertex, indexcount, index)
-    , indexcount(indexcount)
+    : ShapeIndex(size, Weld(vertexcount, vertex, indexcount, index, 2))
+  {
+  }
+
+  // 既存の図形データを使うコンストラクタ
+  //   object: 図形データのハンドル
+  ShapeIndex(Handle<Object> object)
+    : Shape(object)
+    , indexcount(Resource<Object>::pool()[object].getIndexCount())
   {
   }
 
@@ -35,4 +55,12 @@ public:
     // 線分群で描画する
     glDrawElements(GL_LINES, indexcount, GL_UNSIGNED_INT, 0);
   }
+
+  // 描画の実行の記録
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 線分群で描画する
+    commands.drawElements(GL_LINES, indexcount, GL_UNSIGNED_INT, 0);
+  }
 };
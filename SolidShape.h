@@ -20,10 +20,25 @@ public:
   {
   }
 
+  // 既存の図形データを使うコンストラクタ
+  //   object: 図形データのハンドル
+  SolidShape(Handle<Object> object)
+    : Shape(object)
+  {
+  }
+
   // 描画の実行
   virtual void execute() const
   {
     // 三角形で描画する
     glDrawArrays(GL_TRIANGLES, 0, vertexcount);
   }
+
+  // 描画の実行の記録
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 三角形で描画する
+    commands.drawArrays(GL_TRIANGLES, 0, vertexcount);
+  }
 };
@@ -19,7 +19,22 @@ public:
   //   index: 頂点のインデックスを格納した配列
   SolidShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
     GLsizei indexcount, const GLuint *index)
-    : ShapeIndex(size, vertexcount, vertex, indexcount, index)
+    : ShapeIndex(size, Weld(vertexcount, vertex, indexcount, index, 3))
+  {
+  }
+
+  // 溶接した頂点を使うコンストラクタ
+  //   size: 頂点の位置の次元
+  //   weld: 溶接した頂点属性とインデックス
+  SolidShapeIndex(GLint size, const Weld &weld)
+    : ShapeIndex(size, weld)
+  {
+  }
+
+  // 既存の図形データを使うコンストラクタ
+  //   object: 図形データのハンドル
+  SolidShapeIndex(Handle<Object> object)
+    : ShapeIndex(object)
   {
   }
 
@@ -29,4 +44,12 @@ public:
     // 三角形で描画する
     glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
   }
+
+  // 描画の実行の記録
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 三角形で描画する
+    commands.drawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+  }
 };
@@ -0,0 +1,103 @@
+﻿#pragma once
+#include <cmath>
+#include <vector>
+
+// インデックスの一部の範囲を使った三角形による描画
+#include "SolidShapeRange.h"
+
+// メッシュレットの作成
+#include "Meshlet.h"
+
+// 視錐台
+#include "Frustum.h"
+
+//
+// メッシュレット単位で選別した三角形による描画
+//
+class SolidShapeMeshlet
+  : public SolidShapeRange
+{
+  // メッシュレット
+  const std::vector<Meshlet> meshlet;
+
+  // 作成したメッシュレットを使うコンストラクタ
+  //   size: 頂点の位置の次元
+  //   weld: 溶接した頂点属性とインデックス
+  //   builder: 作成したメッシュレット
+  SolidShapeMeshlet(GLint size, const Weld &weld, const MeshletBuilder &builder)
+    : SolidShapeRange(size, Weld(weld.getVertexCount(), weld.getVertex(),
+      static_cast<GLsizei>(builder.getIndex().size()), builder.getIndex().data(), 0))
+    , meshlet(builder.getMeshlet())
+  {
+  }
+
+  // 溶接した頂点を使うコンストラクタ
+  //   size: 頂点の位置の次元
+  //   weld: 溶接した頂点属性とインデックス
+  SolidShapeMeshlet(GLint size, const Weld &weld)
+    : SolidShapeMeshlet(size, weld, MeshletBuilder(weld.getVertexCount(), weld.getVertex(),
+      weld.getIndexCount(), weld.getIndex()))
+  {
+  }
+
+public:
+
+  // コンストラクタ
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  SolidShapeMeshlet(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+    : SolidShapeMeshlet(size, Weld(vertexcount, vertex, indexcount, index, 3))
+  {
+  }
+
+  // 描画するメッシュレットを選ぶ
+  //   projection: 投影変換行列
+  //   modelview: モデルビュー変換行列
+  void cull(const Matrix &projection, const Matrix &modelview)
+  {
+    // 描画する範囲を空にする
+    clear();
+
+    // モデル座標系における視錐台
+    const Frustum frustum(projection * modelview);
+
+    // モデルビュー変換行列の左上 3x3 の余因子行列と行列式
+    GLfloat c[9];
+    modelview.getNormalMatrix(c);
+    const GLfloat det(modelview[0] * c[0] + modelview[4] * c[3] + modelview[8] * c[6]);
+    if (det == 0.0f) return;
+
+    // モデル座標系における視点の位置
+    GLfloat eye[3];
+    for (int i = 0; i < 3; ++i)
+    {
+      eye[i] = -(c[i * 3] * modelview[12] + c[i * 3 + 1] * modelview[13]
+        + c[i * 3 + 2] * modelview[14]) / det;
+    }
+
+    for (const Meshlet &m : meshlet)
+    {
+      // 視錐台の外にあるメッシュレットは描かない
+      if (!frustum.sphere(m.center, m.radius)) continue;
+
+      // 全ての三角形が視点に背を向けているメッシュレットは描かない
+      const GLfloat d[] = { m.center[0] - eye[0], m.center[1] - eye[1], m.center[2] - eye[2] };
+      const GLfloat l(sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+      if (d[0] * m.axis[0] + d[1] * m.axis[1] + d[2] * m.axis[2] >= m.cutoff * l + m.radius)
+        continue;
+
+      // メッシュレットの三角形を描画する範囲に加える
+      add(m.triangleoffset * 3, m.trianglecount * 3);
+    }
+  }
+
+  // 全ての三角形の数を取り出す
+  GLsizei getTotalTriangleCount() const
+  {
+    return indexcount / 3;
+  }
+};
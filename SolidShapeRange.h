@@ -0,0 +1,100 @@
+﻿#pragma once
+#include <vector>
+
+// インデックスを使った三角形による描画
+#include "SolidShapeIndex.h"
+
+//
+// インデックスの一部の範囲を使った三角形による描画
+//
+class SolidShapeRange
+  : public SolidShapeIndex
+{
+  // 描画する範囲の先頭位置
+  std::vector<const GLvoid *> first;
+
+  // 描画する範囲のインデックスの数
+  std::vector<GLsizei> count;
+
+protected:
+
+  // 描画する三角形の数
+  GLsizei trianglecount;
+
+public:
+
+  // コンストラクタ
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  SolidShapeRange(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+    : SolidShapeIndex(size, vertexcount, vertex, indexcount, index)
+    , trianglecount(0)
+  {
+  }
+
+  // 溶接した頂点を使うコンストラクタ
+  //   size: 頂点の位置の次元
+  //   weld: 溶接した頂点属性とインデックス
+  SolidShapeRange(GLint size, const Weld &weld)
+    : SolidShapeIndex(size, weld)
+    , trianglecount(0)
+  {
+  }
+
+  // 描画する範囲を空にする
+  void clear()
+  {
+    first.clear();
+    count.clear();
+    trianglecount = 0;
+  }
+
+  // 描画する範囲を追加する
+  //   start: 範囲の先頭のインデックスの位置
+  //   n: 範囲のインデックスの数
+  void add(GLuint start, GLsizei n)
+  {
+    const GLvoid *const p(static_cast<const GLuint *>(0) + start);
+
+    // 直前の範囲に続いていれば一つにまとめる
+    if (!count.empty() && static_cast<const GLuint *>(first.back()) + count.back() == p)
+      count.back() += n;
+    else
+    {
+      first.emplace_back(p);
+      count.emplace_back(n);
+    }
+
+    trianglecount += n / 3;
+  }
+
+  // 描画する三角形の数を取り出す
+  GLsizei getTriangleCount() const
+  {
+    return trianglecount;
+  }
+
+  // 描画の実行
+  virtual void execute() const
+  {
+    // 描画する範囲がなければ何もしない
+    if (count.empty()) return;
+
+    // 範囲ごとに三角形で描画する
+    glMultiDrawElements(GL_TRIANGLES, count.data(), GL_UNSIGNED_INT,
+      first.data(), static_cast<GLsizei>(count.size()));
+  }
+
+  // 描画の実行の記録 (記録したときの範囲を描く)
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 範囲ごとに三角形で描画する
+    commands.multiDrawElements(GL_TRIANGLES, count.data(), GL_UNSIGNED_INT,
+      first.data(), static_cast<GLsizei>(count.size()));
+  }
+};
@@ -0,0 +1,111 @@
+﻿#pragma once
+#include <memory>
+
+// 図形の描画
+#include "Shape.h"
+
+// インデックスを使った三角形による描画
+#include "SolidShapeIndex.h"
+
+// 三角形ストリップの作成
+#include "Strip.h"
+
+// OpenGL の状態の記録
+#include "State.h"
+
+//
+// 三角形ストリップによる描画
+//
+class SolidShapeStrip
+  : public Shape
+{
+  // 描画に使う頂点のインデックスの数
+  const GLsizei indexcount;
+
+public:
+
+  // インデックスの数の統計
+  struct Stats
+  {
+    // 三角形で描く場合と実際に選んだ描き方のインデックスの数
+    unsigned long long listIndex, chosenIndex;
+  };
+
+  // コンストラクタ
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   strip: 作成した三角形ストリップ
+  SolidShapeStrip(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
+    const StripBuilder &strip)
+    : Shape(size, vertexcount, vertex,
+      static_cast<GLsizei>(strip.getIndex().size()), strip.getIndex().data())
+    , indexcount(static_cast<GLsizei>(strip.getIndex().size()))
+  {
+  }
+
+  // 三角形ストリップと三角形のうちインデックスの少ない方で図形を作る
+  //   size: 頂点の位置の次元
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 三角形の頂点のインデックスの要素数
+  //   index: 三角形の頂点のインデックスを格納した配列
+  static std::unique_ptr<Shape> create(GLint size,
+    GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index)
+  {
+    // 頂点を溶接してから三角形ストリップを作る
+    const Weld weld(vertexcount, vertex, indexcount, index, 3);
+    const StripBuilder strip(weld.getIndexCount(), weld.getIndex());
+
+    // インデックスの数を比べる
+    const GLsizei stripcount(static_cast<GLsizei>(strip.getIndex().size()));
+    const bool useStrip(stripcount < weld.getIndexCount());
+
+    Stats &s(stats());
+    s.listIndex += weld.getIndexCount();
+    s.chosenIndex += useStrip ? stripcount : weld.getIndexCount();
+
+    if (useStrip)
+      return std::unique_ptr<Shape>(new SolidShapeStrip(size,
+        weld.getVertexCount(), weld.getVertex(), strip));
+
+    return std::unique_ptr<Shape>(new SolidShapeIndex(size, weld));
+  }
+
+  // 描画の実行
+  virtual void execute() const
+  {
+    // 基本図形の再開を有効にする
+    glPrimitiveRestartIndex(StripBuilder::restart);
+    State::get().enable(GL_PRIMITIVE_RESTART);
+
+    // 三角形ストリップで描画する
+    glDrawElements(GL_TRIANGLE_STRIP, indexcount, GL_UNSIGNED_INT, 0);
+
+    // 基本図形の再開を無効に戻す
+    State::get().disable(GL_PRIMITIVE_RESTART);
+  }
+
+  // 描画の実行の記録
+  //   commands: 描画命令を記録する先
+  virtual void encode(CommandBuffer &commands) const
+  {
+    // 基本図形の再開を有効にする
+    commands.primitiveRestartIndex(StripBuilder::restart);
+    commands.enable(GL_PRIMITIVE_RESTART);
+
+    // 三角形ストリップで描画する
+    commands.drawElements(GL_TRIANGLE_STRIP, indexcount, GL_UNSIGNED_INT, 0);
+
+    // 基本図形の再開を無効に戻す
+    commands.disable(GL_PRIMITIVE_RESTART);
+  }
+
+  // これまでに作成した図形のインデックスの数の統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
@@ -0,0 +1,325 @@
+﻿#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+//
+// OpenGL の状態を覚えておき変化のない呼び出しを省く
+//
+// 頂点配列オブジェクトの結合状態は頂点配列オブジェクトに属するので
+// GL_ELEMENT_ARRAY_BUFFER の結合は覚えずにそのまま発行する
+//
+class State
+{
+  // 結合しているバッファオブジェクト
+  struct Binding
+  {
+    // 結合ターゲット
+    GLenum target;
+
+    // 結合ポイント (インデックス付きでなければ 0)
+    GLuint index;
+
+    // バッファオブジェクト名
+    GLuint buffer;
+
+    // 結合した範囲
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  // 有効・無効にした機能
+  struct Capability
+  {
+    // 機能
+    GLenum cap;
+
+    // 有効なら true
+    bool enabled;
+  };
+
+  // 使用しているプログラムオブジェクト名
+  GLuint program;
+
+  // 結合している頂点配列オブジェクト名
+  GLuint vao;
+
+  // ターゲットごとに結合しているバッファオブジェクト
+  std::vector<Binding> buffer;
+
+  // 結合ポイントごとに結合しているバッファオブジェクト
+  std::vector<Binding> indexed;
+
+  // 有効・無効にした機能
+  std::vector<Capability> capability;
+
+  // デプスバッファとカラーバッファへの書き込み
+  GLboolean depthmask, colormask[4];
+
+  // デプステストの比較関数と削除する面と表面の向き
+  GLenum depthfunc, cullface, frontface;
+
+  // それぞれの状態をまだ設定していなければ true
+  bool unknownDepthMask, unknownColorMask, unknownDepthFunc, unknownCullFace, unknownFrontFace;
+
+  // コンストラクタ (プログラムと頂点配列オブジェクトの結合は既定値から始まる)
+  State()
+    : program(0), vao(0)
+    , depthmask(GL_TRUE), colormask{ GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE }
+    , depthfunc(GL_LESS), cullface(GL_BACK), frontface(GL_CCW)
+    , unknownDepthMask(true), unknownColorMask(true), unknownDepthFunc(true)
+    , unknownCullFace(true), unknownFrontFace(true)
+  {
+  }
+
+  // コピーコンストラクタによるコピー禁止
+  State(const State &s);
+
+  // 代入によるコピー禁止
+  State &operator=(const State &s);
+
+  // 呼び出しを発行したか省いたかを数える
+  //   changed: 状態が変わるなら true
+  static bool count(bool changed)
+  {
+    Stats &s(stats());
+    if (changed) ++s.issued; else ++s.skipped;
+    return changed;
+  }
+
+  // 記録を探す (見つからなければ追加する)
+  //   table: 記録の表
+  //   target: 結合ターゲット
+  //   index: 結合ポイント
+  //   found: 見つかれば true
+  static Binding &find(std::vector<Binding> &table, GLenum target, GLuint index, bool &found)
+  {
+    for (Binding &b : table)
+    {
+      if (b.target == target && b.index == index)
+      {
+        found = true;
+        return b;
+      }
+    }
+
+    found = false;
+    const Binding b = { target, index, 0, 0, 0 };
+    table.emplace_back(b);
+    return table.back();
+  }
+
+  // 機能を有効・無効にする
+  //   cap: 機能
+  //   enabled: 有効にするなら true
+  void set(GLenum cap, bool enabled)
+  {
+    for (Capability &c : capability)
+    {
+      if (c.cap == cap)
+      {
+        if (!count(c.enabled != enabled)) return;
+        c.enabled = enabled;
+        if (enabled) glEnable(cap); else glDisable(cap);
+        return;
+      }
+    }
+
+    count(true);
+    const Capability c = { cap, enabled };
+    capability.emplace_back(c);
+    if (enabled) glEnable(cap); else glDisable(cap);
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 発行した呼び出しの数
+    unsigned long long issued;
+
+    // 状態が変わらないので省いた呼び出しの数
+    unsigned long long skipped;
+  };
+
+  // 状態の記録を取り出す (終了時の破棄の順序に左右されないように解放しない)
+  static State &get()
+  {
+    static State *const instance(new State);
+    return *instance;
+  }
+
+  // プログラムオブジェクトを使用する
+  //   name: プログラムオブジェクト名
+  void useProgram(GLuint name)
+  {
+    if (!count(program != name)) return;
+    program = name;
+    glUseProgram(name);
+  }
+
+  // 頂点配列オブジェクトを結合する
+  //   name: 頂点配列オブジェクト名
+  void bindVertexArray(GLuint name)
+  {
+    if (!count(vao != name)) return;
+    vao = name;
+    glBindVertexArray(name);
+  }
+
+  // バッファオブジェクトを結合する
+  //   target: 結合ターゲット
+  //   name: バッファオブジェクト名
+  void bindBuffer(GLenum target, GLuint name)
+  {
+    if (target != GL_ELEMENT_ARRAY_BUFFER)
+    {
+      bool found;
+      Binding &b(find(buffer, target, 0, found));
+      if (!count(!found || b.buffer != name)) return;
+      b.buffer = name;
+    }
+    else
+      count(true);
+
+    glBindBuffer(target, name);
+  }
+
+  // バッファオブジェクトの範囲を結合ポイントに結合する
+  //   target: 結合ターゲット
+  //   index: 結合ポイント
+  //   name: バッファオブジェクト名
+  //   offset: 結合する範囲の先頭
+  //   size: 結合する範囲のサイズ
+  void bindBufferRange(GLenum target, GLuint index, GLuint name, GLintptr offset, GLsizeiptr size)
+  {
+    bool found;
+    Binding &b(find(indexed, target, index, found));
+    if (!count(!found || b.buffer != name || b.offset != offset || b.size != size)) return;
+    b.buffer = name;
+    b.offset = offset;
+    b.size = size;
+    glBindBufferRange(target, index, name, offset, size);
+
+    // インデックスの付かない結合ターゲットにも結合される
+    Binding &g(find(buffer, target, 0, found));
+    g.buffer = name;
+  }
+
+  // 機能を有効にする
+  //   cap: 機能
+  void enable(GLenum cap)
+  {
+    set(cap, true);
+  }
+
+  // 機能を無効にする
+  //   cap: 機能
+  void disable(GLenum cap)
+  {
+    set(cap, false);
+  }
+
+  // 機能が有効かどうか調べる (設定していなければ既定値の無効とみなす)
+  //   cap: 機能
+  bool isEnabled(GLenum cap) const
+  {
+    for (const Capability &c : capability) if (c.cap == cap) return c.enabled;
+    return false;
+  }
+
+  // デプスバッファへの書き込みを設定する
+  //   flag: 書き込むなら GL_TRUE
+  void depthMask(GLboolean flag)
+  {
+    if (!count(unknownDepthMask || depthmask != flag)) return;
+    unknownDepthMask = false;
+    depthmask = flag;
+    glDepthMask(flag);
+  }
+
+  // カラーバッファへの書き込みを設定する
+  //   r, g, b, a: それぞれの成分を書き込むなら GL_TRUE
+  void colorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+  {
+    if (!count(unknownColorMask || colormask[0] != r || colormask[1] != g
+      || colormask[2] != b || colormask[3] != a)) return;
+    unknownColorMask = false;
+    colormask[0] = r;
+    colormask[1] = g;
+    colormask[2] = b;
+    colormask[3] = a;
+    glColorMask(r, g, b, a);
+  }
+
+  // デプステストの比較関数を設定する
+  //   func: 比較関数
+  void depthFunc(GLenum func)
+  {
+    if (!count(unknownDepthFunc || depthfunc != func)) return;
+    unknownDepthFunc = false;
+    depthfunc = func;
+    glDepthFunc(func);
+  }
+
+  // 削除する面を設定する
+  //   mode: 削除する面
+  void cullFace(GLenum mode)
+  {
+    if (!count(unknownCullFace || cullface != mode)) return;
+    unknownCullFace = false;
+    cullface = mode;
+    glCullFace(mode);
+  }
+
+  // 表面の頂点の並び順を設定する
+  //   mode: 表面の頂点の並び順
+  void frontFace(GLenum mode)
+  {
+    if (!count(unknownFrontFace || frontface != mode)) return;
+    unknownFrontFace = false;
+    frontface = mode;
+    glFrontFace(mode);
+  }
+
+  // デプスバッファへの書き込みの設定を取り出す
+  GLboolean getDepthMask() const
+  {
+    return depthmask;
+  }
+
+  // カラーバッファへの書き込みの設定を取り出す
+  const GLboolean *getColorMask() const
+  {
+    return colormask;
+  }
+
+  // 削除したプログラムオブジェクトを忘れる (名前が再利用されても結合を省かない)
+  //   name: プログラムオブジェクト名
+  void forgetProgram(GLuint name)
+  {
+    if (program == name) program = 0;
+  }
+
+  // 削除した頂点配列オブジェクトを忘れる
+  //   name: 頂点配列オブジェクト名
+  void forgetVertexArray(GLuint name)
+  {
+    if (vao == name) vao = 0;
+  }
+
+  // 削除したバッファオブジェクトを忘れる
+  //   name: バッファオブジェクト名
+  void forgetBuffer(GLuint name)
+  {
+    for (Binding &b : buffer) if (b.buffer == name) b.buffer = 0;
+    for (Binding &b : indexed) if (b.buffer == name) b.buffer = 0;
+  }
+
+  // 呼び出しの統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
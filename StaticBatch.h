@@ -0,0 +1,274 @@
+﻿#pragma once
+#include <cmath>
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+// インデックスの一部の範囲を使った三角形による描画
+#include "SolidShapeRange.h"
+
+// 変換行列
+#include "Matrix.h"
+
+// 視錐台
+#include "Frustum.h"
+
+// 並列処理
+#include "Parallel.h"
+
+//
+// 動かない図形を材質ごとにまとめて描く
+//
+// 登録した図形の頂点をワールド座標系に変換して材質ごとに一つの図形にまとめる。
+// 変換は build() でワーカースレッドに分けて行い、元の図形ごとの境界球で選別する
+//
+class StaticBatch
+{
+  // 登録された図形
+  struct Source
+  {
+    // 溶接した頂点属性
+    std::vector<Object::Vertex> vertex;
+
+    // 溶接した頂点のインデックス
+    std::vector<GLuint> index;
+
+    // モデル変換行列
+    Matrix model;
+
+    // 材質の番号
+    unsigned int material;
+  };
+
+  // まとめた図形の中の元の図形の部分
+  struct Part
+  {
+    // 頂点のインデックスの先頭位置
+    GLuint first;
+
+    // 頂点のインデックスの数
+    GLsizei count;
+
+    // ワールド座標系での境界球の中心
+    GLfloat center[3];
+
+    // ワールド座標系での境界球の半径
+    GLfloat radius;
+  };
+
+  // 材質ごとにまとめた図形
+  struct Batch
+  {
+    // 材質の番号
+    unsigned int material;
+
+    // まとめた図形
+    std::unique_ptr<SolidShapeRange> shape;
+
+    // 元の図形の部分
+    std::vector<Part> part;
+  };
+
+  // 登録された図形
+  std::vector<Source> source;
+
+  // 材質ごとにまとめた図形
+  std::vector<Batch> batch;
+
+  // 図形の頂点を変換してまとめた図形に格納する
+  //   s: 登録された図形
+  //   vertex: まとめた図形の頂点属性の格納先
+  //   index: まとめた図形の頂点のインデックスの格納先
+  //   base: まとめた図形の中でのこの図形の頂点の先頭位置
+  //   part: まとめた図形の中の元の図形の部分
+  static void transform(const Source &s, Object::Vertex *vertex, GLuint *index,
+    GLuint base, Part &part)
+  {
+    // 法線ベクトルの変換行列
+    GLfloat m[9];
+    s.model.getNormalMatrix(m);
+
+    GLfloat pmin[3], pmax[3];
+    for (std::size_t i = 0; i < s.vertex.size(); ++i)
+    {
+      const Object::Vertex &v(s.vertex[i]);
+      Object::Vertex &w(vertex[i]);
+
+      // 位置をワールド座標系に変換する
+      for (int k = 0; k < 3; ++k)
+      {
+        w.position[k] = s.model[k] * v.position[0] + s.model[k + 4] * v.position[1]
+          + s.model[k + 8] * v.position[2] + s.model[k + 12];
+        w.normal[k] = m[k] * v.normal[0] + m[k + 3] * v.normal[1] + m[k + 6] * v.normal[2];
+        pmin[k] = i > 0 ? std::min(pmin[k], w.position[k]) : w.position[k];
+        pmax[k] = i > 0 ? std::max(pmax[k], w.position[k]) : w.position[k];
+      }
+
+      // 法線ベクトルを正規化する
+      const GLfloat l(sqrt(w.normal[0] * w.normal[0] + w.normal[1] * w.normal[1]
+        + w.normal[2] * w.normal[2]));
+      if (l > 0.0f) for (int k = 0; k < 3; ++k) w.normal[k] /= l;
+    }
+
+    // 頂点のインデックスをまとめた図形の中での番号にする
+    for (std::size_t i = 0; i < s.index.size(); ++i) index[i] = s.index[i] + base;
+
+    // ワールド座標系での境界球を求める
+    GLfloat r2(0.0f);
+    for (int k = 0; k < 3; ++k) part.center[k] = (pmin[k] + pmax[k]) * 0.5f;
+    for (std::size_t i = 0; i < s.vertex.size(); ++i)
+    {
+      const GLfloat *const p(vertex[i].position);
+      const GLfloat dx(p[0] - part.center[0]), dy(p[1] - part.center[1]), dz(p[2] - part.center[2]);
+      r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    part.radius = sqrt(r2);
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 描画命令の数
+    unsigned long long draws;
+
+    // 視錐台の中にあった元の図形の数
+    unsigned long long visible;
+
+    // 視錐台の外にあったので除いた元の図形の数
+    unsigned long long culled;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // 動かない図形を登録する (頂点属性とインデックスは図形データから読み出す)
+  //   shape: 図形 (三角形で描くもの)
+  //   model: モデル変換行列
+  //   material: 材質の番号
+  void add(const SolidShapeIndex &shape, const Matrix &model, unsigned int material)
+  {
+    // 図形データは作成時に溶接済みなのでそのまま使う
+    source.emplace_back();
+    Source &s(source.back());
+    Resource<Object>::pool()[shape.getObject()].read(s.vertex, s.index);
+    s.model = model;
+    s.material = material;
+  }
+
+  // 登録された図形を材質ごとにまとめる
+  void build()
+  {
+    // 材質ごとに図形を分ける
+    std::map<unsigned int, std::vector<std::size_t>> group;
+    for (std::size_t i = 0; i < source.size(); ++i) group[source[i].material].emplace_back(i);
+
+    for (const auto &g : group)
+    {
+      // まとめた図形の中での各図形の頂点とインデックスの先頭位置を求める
+      const std::size_t n(g.second.size());
+      std::vector<GLuint> vbase(n + 1, 0), ibase(n + 1, 0);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        const Source &s(source[g.second[i]]);
+        vbase[i + 1] = vbase[i] + static_cast<GLuint>(s.vertex.size());
+        ibase[i + 1] = ibase[i] + static_cast<GLuint>(s.index.size());
+      }
+
+      // 各図形をワールド座標系に変換して並列にまとめる
+      std::vector<Object::Vertex> vertex(vbase[n]);
+      std::vector<GLuint> index(ibase[n]);
+      std::vector<Part> part(n);
+      parallelFor(0, static_cast<int>(n), [&](int b, int e)
+      {
+        for (int i = b; i < e; ++i)
+        {
+          transform(source[g.second[i]], vertex.data() + vbase[i], index.data() + ibase[i],
+            vbase[i], part[i]);
+          part[i].first = ibase[i];
+          part[i].count = ibase[i + 1] - ibase[i];
+        }
+      });
+
+      // まとめた図形を作る (登録時に溶接済みなので溶接しない)
+      batch.emplace_back();
+      Batch &b(batch.back());
+      b.material = g.first;
+      b.shape.reset(new SolidShapeRange(3, Weld(static_cast<GLsizei>(vertex.size()), vertex.data(),
+        static_cast<GLsizei>(index.size()), index.data(), 0)));
+      b.part.swap(part);
+    }
+
+    // 登録された図形はもう使わない
+    source.clear();
+  }
+
+  // 視錐台の外にある部分を除いて描画する範囲を決める
+  //   projection: 投影変換行列
+  //   view: ビュー変換行列
+  void cull(const Matrix &projection, const Matrix &view)
+  {
+    const Frustum frustum(projection * view);
+
+    for (Batch &b : batch)
+    {
+      b.shape->clear();
+      for (const Part &p : b.part)
+      {
+        if (frustum.sphere(p.center, p.radius))
+        {
+          b.shape->add(p.first, p.count);
+          ++stats().visible;
+        }
+        else
+          ++stats().culled;
+      }
+    }
+  }
+
+  // まとめた図形の数を取り出す
+  std::size_t getBatchCount() const
+  {
+    return batch.size();
+  }
+
+  // まとめた元の図形の数を取り出す
+  std::size_t getPartCount() const
+  {
+    std::size_t count(0);
+    for (const Batch &b : batch) count += b.part.size();
+    return count;
+  }
+
+  // まとめた図形の材質の番号を取り出す
+  //   i: まとめた図形の番号
+  unsigned int getMaterial(std::size_t i) const
+  {
+    return batch[i].material;
+  }
+
+  // まとめた図形を描画する (頂点はワールド座標系にある)
+  //   i: まとめた図形の番号
+  void draw(std::size_t i) const
+  {
+    // 全て視錐台の外にあれば描かない
+    if (batch[i].shape->getTriangleCount() == 0) return;
+
+    batch[i].shape->draw();
+    ++stats().draws;
+  }
+
+  // 描画する三角形の数を取り出す
+  GLsizei getTriangleCount() const
+  {
+    GLsizei count(0);
+    for (const Batch &b : batch) count += b.shape->getTriangleCount();
+    return count;
+  }
+};
@@ -0,0 +1,114 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+//
+// 三角形ストリップの作成
+//
+class StripBuilder
+{
+  // 三角形ストリップの頂点のインデックス
+  std::vector<GLuint> index;
+
+  // 三角形ストリップの数
+  GLsizei stripcount;
+
+  // 有向辺のキーを求める
+  //   u, v: 辺の始点と終点の頂点番号
+  static std::uint64_t edge(GLuint u, GLuint v)
+  {
+    return static_cast<std::uint64_t>(u) << 32 | v;
+  }
+
+public:
+
+  // 基本図形の再開を表すインデックス
+  static constexpr GLuint restart = 0xffffffff;
+
+  // コンストラクタ
+  //   indexcount: 三角形の頂点のインデックスの要素数
+  //   triangle: 三角形の頂点のインデックスを格納した配列
+  StripBuilder(GLsizei indexcount, const GLuint *triangle)
+    : stripcount(0)
+  {
+    // 三角形の数
+    const GLsizei count(indexcount / 3);
+
+    // 有向辺からその辺を含む三角形を引く表を作る
+    std::unordered_map<std::uint64_t, GLsizei> owner;
+    owner.reserve(indexcount);
+    for (GLsizei t = 0; t < count; ++t)
+    {
+      const GLuint *const i(triangle + t * 3);
+      for (int k = 0; k < 3; ++k) owner.emplace(edge(i[k], i[(k + 1) % 3]), t);
+    }
+
+    // 三角形ストリップに使った三角形
+    std::vector<bool> used(count, false);
+
+    // 作成中の三角形ストリップと使った三角形
+    std::vector<GLuint> strip, best;
+    std::vector<GLsizei> visited, bestVisited;
+
+    for (GLsizei seed = 0; seed < count; ++seed)
+    {
+      if (used[seed]) continue;
+
+      // 開始する三角形の三通りの向きのうち最も長く伸びるものを選ぶ
+      best.clear();
+      bestVisited.clear();
+      for (int r = 0; r < 3; ++r)
+      {
+        const GLuint *const i(triangle + seed * 3);
+        strip.assign({ i[r], i[(r + 1) % 3], i[(r + 2) % 3] });
+        visited.assign(1, seed);
+        used[seed] = true;
+
+        for (;;)
+        {
+          // 偶数番目の三角形は (p, q, x), 奇数番目は (q, p, x) の順に頂点が並ぶ
+          const GLuint p(strip[strip.size() - 2]), q(strip.back());
+          const bool odd((strip.size() & 1) != 0);
+          const auto o(owner.find(odd ? edge(q, p) : edge(p, q)));
+          if (o == owner.end() || used[o->second]) break;
+
+          // 隣の三角形の残りの頂点を加える
+          const GLuint *const j(triangle + o->second * 3);
+          GLuint x(j[0]);
+          for (int k = 0; k < 3; ++k) if (j[k] != p && j[k] != q) x = j[k];
+          strip.emplace_back(x);
+          visited.emplace_back(o->second);
+          used[o->second] = true;
+        }
+
+        // 試した三角形を未使用に戻す
+        for (const GLsizei t : visited) used[t] = false;
+
+        if (strip.size() > best.size())
+        {
+          best.swap(strip);
+          bestVisited.swap(visited);
+        }
+      }
+
+      // 選んだ三角形ストリップを使用済みにして登録する
+      for (const GLsizei t : bestVisited) used[t] = true;
+      if (stripcount++ > 0) index.emplace_back(static_cast<GLuint>(restart));
+      index.insert(index.end(), best.begin(), best.end());
+    }
+  }
+
+  // 三角形ストリップの頂点のインデックスを取り出す
+  const std::vector<GLuint> &getIndex() const
+  {
+    return index;
+  }
+
+  // 三角形ストリップの数を取り出す
+  GLsizei getStripCount() const
+  {
+    return stripcount;
+  }
+};
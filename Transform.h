@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <array>
+#include <cstddef>
+#include <GL/glew.h>
+
+// 変換行列
+#include "Matrix.h"
+
+// uniform ブロックの配置
+#include "Layout.h"
+
+//
+// 描画ごとの変換行列
+//
+struct Transform
+{
+  // モデルビュー変換行列
+  alignas(16) std::array<GLfloat, 16> modelview;
+
+  // 法線ベクトルの変換行列 (std140 の mat3 は列ごとに vec4 の境界にそろえる)
+  alignas(16) std::array<GLfloat, 12> normalMatrix;
+
+  // 材質の番号
+  alignas(4) GLint material;
+
+  // コンストラクタ
+  //   m: モデルビュー変換行列
+  //   material: 材質の番号
+  Transform(const Matrix &m, GLint material = 0)
+    : material(material)
+  {
+    for (int i = 0; i < 16; ++i) modelview[i] = m[i];
+
+    GLfloat n[9];
+    m.getNormalMatrix(n);
+    for (int j = 0; j < 3; ++j)
+    {
+      for (int i = 0; i < 3; ++i) normalMatrix[j * 4 + i] = n[j * 3 + i];
+      normalMatrix[j * 4 + 3] = 0.0f;
+    }
+  }
+};
+
+// point.vert の uniform ブロック Transform の配置
+typedef Layout<Packing::Std140, glsl::Mat<4>, glsl::Mat<3>, glsl::Scalar> TransformLayout;
+
+// 構造体の配置が uniform ブロックの配置と一致していることを確かめる
+static_assert(offsetof(Transform, modelview) == TransformLayout::offset(0), "Transform::modelview is misplaced");
+static_assert(offsetof(Transform, normalMatrix) == TransformLayout::offset(1), "Transform::normalMatrix is misplaced");
+static_assert(offsetof(Transform, material) == TransformLayout::offset(2), "Transform::material is misplaced");
+static_assert(sizeof (Transform) == TransformLayout::bytes(), "Transform does not match std140");
@@ -1,53 +1,197 @@
 ﻿#pragma once
-#include <memory>
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <algorithm>
 #include <GL/glew.h>
 
+// 資源の管理
+#include "Resource.h"
+
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
 //
 // ユニフォームバッファオブジェクト
 //
-template <typename T>
-class Uniform
+class UniformBuffer
 {
-  struct UniformBuffer
+  // ユニフォームバッファオブジェクト名
+  GLuint ubo;
+
+  // ユニフォームブロックのサイズ
+  GLsizeiptr blocksize;
+
+  // 確保したサイズ
+  GLsizeiptr buffersize;
+
+  // 境界をそろえて並べた uniform ブロックの CPU 側の写し
+  std::vector<char> staging;
+
+  // まだ転送していない範囲の先頭と末尾の次の位置
+  GLsizeiptr dirtyfirst, dirtylast;
+
+  // コピーコンストラクタによるコピー禁止
+  UniformBuffer(const UniformBuffer &u);
+
+  // 代入によるコピー禁止
+  UniformBuffer &operator=(const UniformBuffer &u);
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // バッファオブジェクトへの転送の回数
+    unsigned long long uploads;
+
+    // 転送した uniform ブロックの数
+    unsigned long long blocks;
+
+    // 転送したバイト数
+    unsigned long long bytes;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
   {
-    // ユニフォームバッファオブジェクト名
-    GLuint ubo;
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   data: uniform ブロックに格納するデータ
+  //   size: uniform ブロックに格納するデータのサイズ
+  //   count: 確保する uniform ブロックの数
+  UniformBuffer(const void *data, GLsizeiptr size, unsigned int count)
+    : dirtyfirst(0), dirtylast(0)
+  {
+    // ユニフォームブロックのサイズを求める
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    blocksize = (((size - 1) / alignment) + 1) * alignment;
+
+    // 境界をそろえて並べた uniform ブロックを作る
+    buffersize = count * blocksize;
+    staging.resize(buffersize);
+    if (data != NULL) write(data, size, 0, count);
+
+    // ユニフォームバッファオブジェクトを作成して一度に転送する (同じサイズの空きがあれば再利用する)
+    ubo = ReleaseQueue::get().createBuffer(GL_UNIFORM_BUFFER,
+      buffersize, data != NULL ? staging.data() : NULL, GL_STATIC_DRAW);
+    if (data == NULL) return;
+    dirtyfirst = dirtylast = 0;
+    Stats &s(stats());
+    ++s.uploads;
+    s.blocks += count;
+    s.bytes += buffersize;
+  }
 
-    // ユニフォームブロックのサイズ
-    GLsizeiptr blocksize;
+  // ムーブコンストラクタ
+  UniformBuffer(UniformBuffer &&u)
+    : ubo(u.ubo), blocksize(u.blocksize), buffersize(u.buffersize)
+    , staging(std::move(u.staging)), dirtyfirst(u.dirtyfirst), dirtylast(u.dirtylast)
+  {
+    u.ubo = 0;
+  }
 
-    // コンストラクタ
-    //   data: uniform ブロックに格納するデータ
-    //   count: 確保する uniform ブロックの数
-    UniformBuffer(const T *data, unsigned int count)
+  // デストラクタ
+  ~UniformBuffer()
+  {
+    // GPU が使い終わってからユニフォームバッファオブジェクトを削除する
+    ReleaseQueue::get().deleteBuffer(ubo, buffersize, GL_STATIC_DRAW);
+  }
+
+  // ムーブ代入
+  UniformBuffer &operator=(UniformBuffer &&u)
+  {
+    if (this != &u)
     {
-      // ユニフォームブロックのサイズを求める
-      GLint alignment;
-      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
-      blocksize = (((sizeof (T) - 1) / alignment) + 1) * alignment;
-
-      // ユニフォームバッファオブジェクトを作成する
-      glGenBuffers(1, &ubo);
-      glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-      glBufferData(GL_UNIFORM_BUFFER,
-        count * blocksize, NULL, GL_STATIC_DRAW);
-      for (unsigned int i = 0; i < count; ++i)
-      {
-        glBufferSubData(GL_UNIFORM_BUFFER, i * blocksize,
-          sizeof (T), data + i);
-      }
+      // 今のユニフォームバッファオブジェクトを削除して移動元のものを引き継ぐ
+      ReleaseQueue::get().deleteBuffer(ubo, buffersize, GL_STATIC_DRAW);
+      ubo = u.ubo;
+      blocksize = u.blocksize;
+      buffersize = u.buffersize;
+      staging = std::move(u.staging);
+      dirtyfirst = u.dirtyfirst;
+      dirtylast = u.dirtylast;
+      u.ubo = 0;
     }
 
-    // デストラクタ
-    ~UniformBuffer()
+    return *this;
+  }
+
+  // CPU 側の写しにデータを書き込んで転送する範囲に加える
+  //   data: uniform ブロックに格納するデータ
+  //   size: uniform ブロックに格納するデータのサイズ
+  //   start: データを格納する uniform ブロックの先頭位置
+  //   count: データを格納する uniform ブロックの数
+  void write(const void *data, GLsizeiptr size, unsigned int start, unsigned int count)
+  {
+    if (count == 0) return;
+    for (unsigned int i = 0; i < count; ++i)
     {
-      // ユニフォームバッファオブジェクトを削除する
-      glDeleteBuffers(1, &ubo);
+      std::memcpy(staging.data() + (start + i) * blocksize,
+        static_cast<const char *>(data) + i * size, size);
     }
-  };
 
+    // 転送する範囲を一つにまとめる
+    const GLsizeiptr first(start * blocksize), last((start + count) * blocksize);
+    if (dirtyfirst == dirtylast)
+    {
+      dirtyfirst = first;
+      dirtylast = last;
+    }
+    else
+    {
+      dirtyfirst = std::min(dirtyfirst, first);
+      dirtylast = std::max(dirtylast, last);
+    }
+  }
+
+  // まだ転送していない範囲を一度に転送する
+  void flush()
+  {
+    if (dirtyfirst == dirtylast) return;
+
+    State::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, dirtyfirst, dirtylast - dirtyfirst,
+      staging.data() + dirtyfirst);
+
+    Stats &s(stats());
+    ++s.uploads;
+    s.blocks += (dirtylast - dirtyfirst) / blocksize;
+    s.bytes += dirtylast - dirtyfirst;
+    dirtyfirst = dirtylast = 0;
+  }
+
+  // ユニフォームバッファオブジェクト名を取り出す
+  GLuint getBuffer() const
+  {
+    return ubo;
+  }
+
+  // ユニフォームブロックのサイズを取り出す
+  GLsizeiptr getBlockSize() const
+  {
+    return blocksize;
+  }
+};
+
+//
+// ユニフォームバッファオブジェクトを使う uniform ブロック
+//
+template <typename T>
+class Uniform
+{
   // バッファオブジェクト
-  const std::shared_ptr<const UniformBuffer> buffer;
+  const Handle<UniformBuffer> buffer;
+
+  // コピーコンストラクタによるコピー禁止
+  Uniform(const Uniform &u);
+
+  // 代入によるコピー禁止
+  Uniform &operator=(const Uniform &u);
 
 public:
 
@@ -55,13 +199,15 @@ public:
   //   data: uniform ブロックに格納するデータ
   //   count: 確保する uniform ブロックの数
   Uniform(const T *data = NULL, unsigned int count = 1)
-    : buffer(new UniformBuffer(data, count))
+    : buffer(Resource<UniformBuffer>::pool().create(data, sizeof (T), count))
   {
   }
 
   // デストラクタ
   virtual ~Uniform()
   {
+    // バッファオブジェクトを解放する
+    Resource<UniformBuffer>::pool().release(buffer);
   }
 
   // ユニフォームバッファオブジェクトにデータを格納する
@@ -70,12 +216,8 @@ public:
   //   count: データを格納する uniform ブロックの数
   void set(const T *data, unsigned int start = 0, unsigned int count = 1) const
   {
-    glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
-    for (unsigned int i = 0; i < count; ++i)
-    {
-      glBufferSubData(GL_UNIFORM_BUFFER, (start + i) * buffer->blocksize,
-        sizeof (T), data + i);
-    }
+    // 転送は使用するときにまとめて行う
+    Resource<UniformBuffer>::pool()[buffer].write(data, sizeof (T), start, count);
   }
 
   // このユニフォームバッファオブジェクトを使用する
@@ -83,8 +225,12 @@ public:
   //   i: 結合する uniform ブロックの位置
   void select(GLuint bp, unsigned int i = 0) const
   {
+    // まだ転送していないデータがあれば転送する
+    UniformBuffer &b(Resource<UniformBuffer>::pool()[buffer]);
+    b.flush();
+
     // 結合ポイントにユニフォームバッファオブジェクトを結合する
-    glBindBufferRange(GL_UNIFORM_BUFFER, bp,
-      buffer->ubo, i * buffer->blocksize, sizeof (T));
+    State::get().bindBufferRange(GL_UNIFORM_BUFFER, bp,
+      b.getBuffer(), i * b.getBlockSize(), sizeof (T));
   }
 };
@@ -0,0 +1,212 @@
+﻿#pragma once
+#include <vector>
+#include <cstring>
+#include <GL/glew.h>
+
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
+//
+// フレームごとに使い捨てる uniform ブロックを順に割り当てる環状バッファ
+//
+class UniformRing
+{
+  // ユニフォームバッファオブジェクト名
+  GLuint ubo;
+
+  // 一フレームに使う領域のサイズ
+  GLsizeiptr segment;
+
+  // 環状に使う領域の数
+  const unsigned int frames;
+
+  // 今のフレームに使う領域の番号
+  unsigned int current;
+
+  // 今のフレームの領域の中の次に割り当てる位置
+  GLsizeiptr offset;
+
+  // uniform ブロックの先頭の境界
+  GLint alignment;
+
+  // 領域ごとにそれを使ったフレームの描画の完了を待つ同期オブジェクト
+  std::vector<GLsync> fence;
+
+  // 常にマップしておいたバッファの先頭 (マップできなければ NULL)
+  char *mapped;
+
+  // コピーコンストラクタによるコピー禁止
+  UniformRing(const UniformRing &r);
+
+  // 代入によるコピー禁止
+  UniformRing &operator=(const UniformRing &r);
+
+  // ユニフォームバッファオブジェクトを作る
+  void create()
+  {
+    const GLsizeiptr size(segment * frames);
+
+    if (GLEW_ARB_buffer_storage)
+    {
+      // マップしたまま描画できるバッファを作る
+      static constexpr GLbitfield flags(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+      glGenBuffers(1, &ubo);
+      State::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+      glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+      mapped = static_cast<char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    }
+    else
+    {
+      // マップしたまま描画できなければ割り当てるたびに転送する
+      ubo = ReleaseQueue::get().createBuffer(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+      mapped = NULL;
+    }
+  }
+
+  // ユニフォームバッファオブジェクトを GPU が使い終わってから削除する
+  void destroy()
+  {
+    for (GLsync &f : fence)
+    {
+      if (f) glDeleteSync(f);
+      f = 0;
+    }
+
+    if (mapped)
+    {
+      // 作り直したバッファは再利用できないので削除する
+      State::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+      ReleaseQueue::get().deleteBuffer(ubo, segment * frames, 0);
+    }
+    else
+      ReleaseQueue::get().deleteBuffer(ubo, segment * frames, GL_STREAM_DRAW);
+  }
+
+public:
+
+  // 統計
+  struct Stats
+  {
+    // 割り当てた uniform ブロックの数
+    unsigned long long blocks;
+
+    // 割り当てたバイト数
+    unsigned long long bytes;
+
+    // 領域が空くのを待った回数
+    unsigned long long waits;
+
+    // 領域が足りずに作り直した回数
+    unsigned long long grows;
+  };
+
+  // 統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+
+  // コンストラクタ
+  //   size: 一フレームに使う領域のサイズ
+  //   frames: 同時に GPU が処理しているかもしれないフレームの数
+  UniformRing(GLsizeiptr size = 256 * 1024, unsigned int frames = 3)
+    : frames(frames), current(0), offset(0), fence(frames, 0)
+  {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    segment = ((size - 1) / alignment + 1) * alignment;
+    create();
+  }
+
+  // デストラクタ
+  ~UniformRing()
+  {
+    destroy();
+  }
+
+  // 今のフレームの領域に uniform ブロックを割り当ててデータを書き込む
+  //   data: uniform ブロックに格納するデータ
+  //   size: uniform ブロックに格納するデータのサイズ
+  //   戻り値: 割り当てた uniform ブロックのバッファ中の位置
+  GLintptr allocate(const void *data, GLsizeiptr size)
+  {
+    // 割り当てる位置を境界にそろえる
+    GLsizeiptr start(((offset + alignment - 1) / alignment) * alignment);
+
+    if (start + size > segment)
+    {
+      // 入りきらなければ大きくして作り直す (古い方は GPU が使い終わってから削除される)
+      destroy();
+      while (segment < size) segment *= 2;
+      segment *= 2;
+      create();
+      current = 0;
+      start = 0;
+      ++stats().grows;
+    }
+
+    // 書き込む
+    const GLintptr where(current * segment + start);
+    if (mapped)
+      std::memcpy(mapped + where, data, size);
+    else
+    {
+      State::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+      glBufferSubData(GL_UNIFORM_BUFFER, where, size, data);
+    }
+    offset = start + size;
+
+    Stats &s(stats());
+    ++s.blocks;
+    s.bytes += size;
+
+    return where;
+  }
+
+  // バッファオブジェクト名を取り出す (領域が足りずに作り直すと変わる)
+  GLuint getBuffer() const
+  {
+    return ubo;
+  }
+
+  // 割り当てた uniform ブロックを結合ポイントに結合する
+  //   bp: 結合ポイント
+  //   where: 割り当てた uniform ブロックのバッファ中の位置
+  //   size: uniform ブロックのサイズ
+  void bind(GLuint bp, GLintptr where, GLsizeiptr size) const
+  {
+    State::get().bindBufferRange(GL_UNIFORM_BUFFER, bp, ubo, where, size);
+  }
+
+  // uniform ブロックを割り当てて結合ポイントに結合する
+  //   bp: 結合ポイント
+  //   data: uniform ブロックに格納するデータ
+  template <typename T>
+  void select(GLuint bp, const T &data)
+  {
+    bind(bp, allocate(&data, sizeof data), sizeof data);
+  }
+
+  // フレームの終わりに呼び出す
+  void frame()
+  {
+    // このフレームの描画の完了を待つ同期オブジェクトを置いて次の領域に移る
+    fence[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % frames;
+    offset = 0;
+
+    // 次の領域を使ったフレームの描画が終わっていなければ待つ
+    GLsync &f(fence[current]);
+    if (!f) return;
+    GLenum status(glClientWaitSync(f, 0, 0));
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+      ++stats().waits;
+      do status = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(f);
+    f = 0;
+  }
+};
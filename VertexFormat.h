@@ -0,0 +1,89 @@
+﻿#pragma once
+#include <GL/glew.h>
+
+//
+// 頂点属性の配置
+//
+enum class VertexLayout
+{
+  // 全ての属性を頂点ごとにまとめる
+  Interleaved,
+
+  // 位置とそれ以外の属性を別の領域に分ける
+  Split,
+
+  // 属性ごとに別の領域に分ける
+  Planar
+};
+
+//
+// 頂点属性の配置のコンパイル時の記述
+//
+template <VertexLayout L>
+struct VertexFormat
+{
+  // 配置
+  static constexpr VertexLayout layout = L;
+
+  // 属性の数 (0: 位置, 1: 法線)
+  static constexpr int attributes = 2;
+
+  // 領域の数
+  static constexpr int streams =
+    L == VertexLayout::Interleaved ? 1 : L == VertexLayout::Split ? 2 : attributes;
+
+  // 属性の成分数
+  //   a: 属性の番号
+  static constexpr GLint components(int a)
+  {
+    return a < attributes ? 3 : 0;
+  }
+
+  // 属性のバイト数
+  //   a: 属性の番号
+  static constexpr GLsizei bytes(int a)
+  {
+    return components(a) * static_cast<GLsizei>(sizeof (GLfloat));
+  }
+
+  // 属性を格納する領域の番号
+  //   a: 属性の番号
+  static constexpr int stream(int a)
+  {
+    return L == VertexLayout::Interleaved ? 0 : L == VertexLayout::Split ? (a == 0 ? 0 : 1) : a;
+  }
+
+  // 領域の一頂点あたりのバイト数 (a 番以降の属性について求める)
+  //   s: 領域の番号
+  //   a: 属性の番号
+  static constexpr GLsizei stride(int s, int a = 0)
+  {
+    return a >= attributes ? 0 : (stream(a) == s ? bytes(a) : 0) + stride(s, a + 1);
+  }
+
+  // 属性の領域内での位置 (b 番以降で a 番より前の属性について求める)
+  //   a: 属性の番号
+  //   b: 属性の番号
+  static constexpr GLsizei offset(int a, int b = 0)
+  {
+    return b >= a ? 0 : (stream(b) == stream(a) ? bytes(b) : 0) + offset(a, b + 1);
+  }
+
+  // 領域の先頭の位置 (s 番より前の領域について求める)
+  //   s: 領域の番号
+  //   count: 頂点の数
+  static constexpr GLsizeiptr base(int s, GLsizei count)
+  {
+    return s <= 0 ? 0 : base(s - 1, count) + static_cast<GLsizeiptr>(stride(s - 1)) * count;
+  }
+};
+
+// 配置の記述の検査
+static_assert(VertexFormat<VertexLayout::Interleaved>::stride(0) == 24,
+  "interleaved vertex must be 24 bytes");
+static_assert(VertexFormat<VertexLayout::Interleaved>::offset(1) == 12,
+  "interleaved normal must follow the position");
+static_assert(VertexFormat<VertexLayout::Split>::stride(0) == 12,
+  "split position stream must be 12 bytes");
+static_assert(VertexFormat<VertexLayout::Planar>::stride(1) == 12,
+  "planar normal stream must be 12 bytes");
@@ -0,0 +1,195 @@
+﻿#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+// 図形データ
+#include "Object.h"
+
+//
+// 頂点の溶接
+//
+class Weld
+{
+  // 溶接した頂点属性
+  std::vector<Object::Vertex> weldedVertex;
+
+  // 溶接した頂点のインデックス
+  std::vector<GLuint> weldedIndex;
+
+  // 頂点の数
+  GLsizei vertexcount;
+
+  // 頂点属性を格納した配列
+  const Object::Vertex *vertex;
+
+  // 頂点のインデックスの要素数
+  GLsizei indexcount;
+
+  // 頂点のインデックスを格納した配列
+  const GLuint *index;
+
+  // 空間ハッシュのセルのキーを求める
+  //   x, y, z: セルの位置
+  static std::uint64_t key(std::int64_t x, std::int64_t y, std::int64_t z)
+  {
+    return static_cast<std::uint64_t>(x) * 73856093u ^
+      static_cast<std::uint64_t>(y) * 19349663u ^
+      static_cast<std::uint64_t>(z) * 83492791u;
+  }
+
+public:
+
+  // 溶接の統計
+  struct Stats
+  {
+    // 溶接前と溶接後の頂点の数
+    unsigned long long vertexIn, vertexOut;
+
+    // 溶接前と溶接後の基本図形の数
+    unsigned long long primitiveIn, primitiveOut;
+  };
+
+  // コンストラクタ
+  //   vertexcount: 頂点の数
+  //   vertex: 頂点属性を格納した配列
+  //   indexcount: 頂点のインデックスの要素数
+  //   index: 頂点のインデックスを格納した配列
+  //   primitive: 基本図形の頂点数 (2 なら線分, 3 なら三角形, 0 なら溶接しない)
+  //   positionEpsilon: 同じ位置とみなす座標値の差
+  //   normalEpsilon: 同じ法線とみなす成分の差
+  Weld(GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index, GLsizei primitive,
+    GLfloat positionEpsilon = 1.0e-5f, GLfloat normalEpsilon = 1.0e-3f)
+    : vertexcount(vertexcount), vertex(vertex)
+    , indexcount(indexcount), index(index)
+  {
+    // 溶接しないときはそのまま使う
+    if (primitive <= 0 || index == NULL) return;
+
+    // 頂点の溶接先の番号
+    std::vector<GLuint> remap(vertexcount);
+
+    // 空間ハッシュの各セルの先頭の頂点と同じセルの次の頂点
+    std::unordered_map<std::uint64_t, GLuint> head;
+    std::vector<GLuint> next;
+    head.reserve(vertexcount);
+    next.reserve(vertexcount);
+
+    weldedVertex.reserve(vertexcount);
+    const GLfloat scale(1.0f / positionEpsilon);
+
+    for (GLsizei i = 0; i < vertexcount; ++i)
+    {
+      const Object::Vertex &v(vertex[i]);
+      const std::int64_t cx(static_cast<std::int64_t>(floor(v.position[0] * scale)));
+      const std::int64_t cy(static_cast<std::int64_t>(floor(v.position[1] * scale)));
+      const std::int64_t cz(static_cast<std::int64_t>(floor(v.position[2] * scale)));
+
+      // 隣接するセルも含めて属性の差が許容値以内の頂点を探す
+      GLuint found(static_cast<GLuint>(weldedVertex.size()));
+      for (int n = 0; n < 27 && found == weldedVertex.size(); ++n)
+      {
+        const auto h(head.find(key(cx + n % 3 - 1, cy + n / 3 % 3 - 1, cz + n / 9 - 1)));
+        if (h == head.end()) continue;
+
+        for (GLuint j = h->second; j != ~0u; j = next[j])
+        {
+          const Object::Vertex &w(weldedVertex[j]);
+          bool same(true);
+          for (int k = 0; k < 3 && same; ++k)
+          {
+            same = fabs(v.position[k] - w.position[k]) <= positionEpsilon
+              && fabs(v.normal[k] - w.normal[k]) <= normalEpsilon;
+          }
+          if (same)
+          {
+            found = j;
+            break;
+          }
+        }
+      }
+
+      // 見つからなければ新しい頂点としてセルに登録する
+      if (found == weldedVertex.size())
+      {
+        weldedVertex.emplace_back(v);
+        const auto h(head.emplace(key(cx, cy, cz), ~0u).first);
+        next.emplace_back(h->second);
+        h->second = found;
+      }
+
+      remap[i] = found;
+    }
+
+    // 頂点の重なった縮退した基本図形を取り除いてインデックスを付け直す
+    weldedIndex.reserve(indexcount);
+    for (GLsizei i = 0; i + primitive <= indexcount; i += primitive)
+    {
+      bool degenerate(false);
+      for (GLsizei k = 0; k < primitive && !degenerate; ++k)
+        for (GLsizei l = 0; l < k && !degenerate; ++l)
+          degenerate = remap[index[i + k]] == remap[index[i + l]];
+      if (degenerate) continue;
+
+      for (GLsizei k = 0; k < primitive; ++k)
+        weldedIndex.emplace_back(remap[index[i + k]]);
+    }
+
+    // 統計を更新する
+    Stats &s(stats());
+    s.vertexIn += vertexcount;
+    s.vertexOut += weldedVertex.size();
+    s.primitiveIn += indexcount / primitive;
+    s.primitiveOut += weldedIndex.size() / primitive;
+
+    // 溶接した結果を使う
+    this->vertexcount = static_cast<GLsizei>(weldedVertex.size());
+    this->vertex = weldedVertex.data();
+    this->indexcount = static_cast<GLsizei>(weldedIndex.size());
+    this->index = weldedIndex.data();
+  }
+
+private:
+
+  // コピーコンストラクタによるコピー禁止
+  Weld(const Weld &w);
+
+  // 代入によるコピー禁止
+  Weld &operator=(const Weld &w);
+
+public:
+
+  // 頂点の数を取り出す
+  GLsizei getVertexCount() const
+  {
+    return vertexcount;
+  }
+
+  // 頂点属性を格納した配列を取り出す
+  const Object::Vertex *getVertex() const
+  {
+    return vertex;
+  }
+
+  // 頂点のインデックスの要素数を取り出す
+  GLsizei getIndexCount() const
+  {
+    return indexcount;
+  }
+
+  // 頂点のインデックスを格納した配列を取り出す
+  const GLuint *getIndex() const
+  {
+    return index;
+  }
+
+  // これまでの溶接の統計を取り出す
+  static Stats &stats()
+  {
+    static Stats s = {};
+    return s;
+  }
+};
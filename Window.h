@@ -3,6 +3,9 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+// 資源の削除の待ち行列
+#include "ReleaseQueue.h"
+
 //
 // ウィンドウ関連の処理
 //
@@ -14,6 +17,9 @@ class Window
   // ウィンドウのサイズ
   GLfloat size[2];
 
+  // ビューポート
+  GLfloat viewport[4];
+
   // ワールド座標系に対するデバイス座標系の拡大率
   GLfloat scale;
 
@@ -71,6 +77,9 @@ public:
   // デストラクタ
   virtual ~Window()
   {
+    // 削除を待っている資源を削除する
+    ReleaseQueue::get().flush();
+
     // ウィンドウを破棄する
     glfwDestroyWindow(window);
   }
@@ -112,6 +121,9 @@ public:
   {
     // カラーバッファを入れ替える
     glfwSwapBuffers(window);
+
+    // 描画が完了した資源を削除する
+    ReleaseQueue::get().frame();
   }
 
   // ウィンドウのサイズ変更時の処理
@@ -133,6 +145,11 @@ public:
       // 開いたウィンドウのサイズを保存する
       instance->size[0] = static_cast<GLfloat>(width);
       instance->size[1] = static_cast<GLfloat>(height);
+
+      // 設定したビューポートを保存する
+      instance->viewport[0] = instance->viewport[1] = 0.0f;
+      instance->viewport[2] = static_cast<GLfloat>(fbWidth);
+      instance->viewport[3] = static_cast<GLfloat>(fbHeight);
     }
   }
 
@@ -167,6 +184,9 @@ public:
   // ウィンドウのサイズを取り出す
   const GLfloat *getSize() const { return size; }
 
+  // ビューポートを取り出す
+  const GLfloat *getViewport() const { return viewport; }
+
   // ワールド座標系に対するデバイス座標系の拡大率を取り出す
   GLfloat getScale() const { return scale; }
 
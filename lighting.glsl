@@ -0,0 +1,43 @@
+uniform samplerBuffer lightData;
+#ifdef CLUSTERED
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer lightIndex;
+uniform ivec3 clusterCount;
+uniform vec4 viewport;
+uniform vec2 clusterDepth;
+#else
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 2
+#endif
+#endif
+void light(int i, vec3 Kamb, vec3 Kdiff, vec4 Kspec, vec4 P, vec3 N, vec3 V, inout vec3 Idiff, inout vec3 Ispec)
+{
+  vec4 Lpos = texelFetch(lightData, i);
+  vec3 D = Lpos.xyz - P.xyz / P.w;
+  float d = length(D) / Lpos.w;
+  float a = clamp(1.0 - d * d, 0.0, 1.0);
+  a *= a;
+  vec3 L = normalize(D);
+  vec3 Iamb = Kamb * texelFetch(lightData, i + 1).rgb;
+  Idiff += (max(dot(N, L), 0.0) * Kdiff * texelFetch(lightData, i + 2).rgb + Iamb) * a;
+  vec3 H = normalize(L + V);
+  Ispec += pow(max(dot(normalize(N), H), 0.0), Kspec.a) * Kspec.rgb * texelFetch(lightData, i + 3).rgb * a;
+}
+vec3 shade(vec3 Kamb, vec3 Kdiff, vec4 Kspec, vec4 P, vec3 N)
+{
+  vec3 V = -normalize(P.xyz);
+  vec3 Idiff = vec3(0.0);
+  vec3 Ispec = vec3(0.0);
+#ifdef CLUSTERED
+  vec2 t = (gl_FragCoord.xy - viewport.xy) / viewport.zw * vec2(clusterCount.xy);
+  float s = log(-P.z / clusterDepth.x) * clusterDepth.y * float(clusterCount.z);
+  ivec3 c = clamp(ivec3(ivec2(t), int(s)), ivec3(0), clusterCount - 1);
+  uvec2 range = texelFetch(clusterData, (c.z * clusterCount.y + c.y) * clusterCount.x + c.x).xy;
+  for (uint k = 0u; k < range.y; ++k)
+    light(int(texelFetch(lightIndex, int(range.x + k)).r) * 4, Kamb, Kdiff, Kspec, P, N, V, Idiff, Ispec);
+#else
+  for (int k = 0; k < LIGHT_COUNT; ++k)
+    light(k * 4, Kamb, Kdiff, Kspec, P, N, V, Idiff, Ispec);
+#endif
+  return Idiff + Ispec;
+}
@@ -1,9 +1,14 @@
 ﻿#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
 #include <memory>
+#include <thread>
+#include <algorithm>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Window.h"
@@ -13,168 +18,180 @@
 #include "ShapeIndex.h"
 #include "SolidShapeIndex.h"
 #include "SolidShape.h"
+#include "SolidShapeMeshlet.h"
+#include "SolidShapeStrip.h"
+#include "MeshRegistry.h"
+#include "DynamicBatch.h"
+#include "StaticBatch.h"
+#include "EditableShape.h"
+#include "Occlusion.h"
 #include "Uniform.h"
+#include "UniformRing.h"
+#include "Transform.h"
 #include "Material.h"
-
-// シェーダオブジェクトのコンパイル結果を表示する
-//   shader: シェーダオブジェクト名
-//   str: コンパイルエラーが発生した場所を示す文字列
-GLboolean printShaderInfoLog(GLuint shader, const char *str)
+#include "MaterialTable.h"
+#include "Program.h"
+#include "LightCluster.h"
+#include "State.h"
+#include "CommandBuffer.h"
+#include "DrawList.h"
+#include "JobSystem.h"
+#include "ProgramCache.h"
+#include "ShaderWatcher.h"
+#include "ProgramVariants.h"
+
+// 球の頂点属性とインデックスを作る
+//   slices: 経度方向の分割数
+//   stacks: 緯度方向の分割数
+//   vertex: 頂点属性の格納先
+//   index: 頂点のインデックスの格納先
+void solidSphere(int slices, int stacks,
+  std::vector<Object::Vertex> &vertex, std::vector<GLuint> &index)
 {
-  // コンパイル結果を取得する
-  GLint status;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-  if (status == GL_FALSE) std::cerr << "Compile Error in " << str << std::endl;
+  // 頂点属性を作る
+  for (int j = 0; j <= stacks; ++j)
+  {
+    const float t(static_cast<float>(j) / static_cast<float>(stacks));
+    const float y(cos(3.141593f * t)), r(sin(3.141593f * t));
 
-  // シェーダのコンパイル時のログの長さを取得する
-  GLsizei bufSize;
-  glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
+    for (int i = 0; i <= slices; ++i)
+    {
+      const float s(static_cast<float>(i) / static_cast<float>(slices));
+      const float z(r * cos(6.283185f * s)), x(r * sin(6.283185f * s));
 
-  if (bufSize > 1)
-  {
-    // シェーダのコンパイル時のログの内容を取得する
-    std::vector<GLchar> infoLog(bufSize);
-    GLsizei length;
-    glGetShaderInfoLog(shader, bufSize, &length, &infoLog[0]);
-    std::cerr << &infoLog[0] << std::endl;
+      // 頂点属性
+      const Object::Vertex v = { x, y, z, x, y, z };
+
+      // 頂点属性を追加する
+      vertex.emplace_back(v);
+    }
   }
 
-  return static_cast<GLboolean>(status);
-}
+  // インデックスを作る
+  for (int j = 0; j < stacks; ++j)
+  {
+    const int k((slices + 1) * j);
 
-// プログラムオブジェクトのリンク結果を表示する
-//   program: プログラムオブジェクト名
-GLboolean printProgramInfoLog(GLuint program)
-{
-  // リンク結果を取得する
-  GLint status;
-  glGetProgramiv(program, GL_LINK_STATUS, &status);
-  if (status == GL_FALSE) std::cerr << "Link Error." << std::endl;
+    for (int i = 0; i < slices; ++i)
+    {
+      // 頂点のインデックス
+      const GLuint k0(k + i);
+      const GLuint k1(k0 + 1);
+      const GLuint k2(k1 + slices);
+      const GLuint k3(k2 + 1);
 
-  // シェーダのリンク時のログの長さを取得する
-  GLsizei bufSize;
-  glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufSize);
+      // 左下の三角形
+      index.emplace_back(k0);
+      index.emplace_back(k2);
+      index.emplace_back(k3);
 
-  if (bufSize > 1)
-  {
-    // シェーダのリンク時のログの内容を取得する
-    std::vector<GLchar> infoLog(bufSize);
-    GLsizei length;
-    glGetProgramInfoLog(program, bufSize, &length, &infoLog[0]);
-    std::cerr << &infoLog[0] << std::endl;
+      // 右上の三角形
+      index.emplace_back(k0);
+      index.emplace_back(k3);
+      index.emplace_back(k1);
+    }
   }
-
-  return static_cast<GLboolean>(status);
 }
 
-// プログラムオブジェクトを作成する
-//   vsrc: バーテックスシェーダのソースプログラムの文字列
-//   fsrc: フラグメントシェーダのソースプログラムの文字列
-GLuint createProgram(const char *vsrc, const char *fsrc)
+// uniform ブロックの数ごとに一つずつ転送する場合とまとめて転送する場合の時間を比べる
+void benchmarkUniform()
 {
-  // 空のプログラムオブジェクトを作成する
-  const GLuint program(glCreateProgram());
+  typedef std::chrono::steady_clock clock;
 
-  if (vsrc != NULL)
-  {
-    // バーテックスシェーダのシェーダオブジェクトを作成する
-    const GLuint vobj(glCreateShader(GL_VERTEX_SHADER));
-    glShaderSource(vobj, 1, &vsrc, NULL);
-    glCompileShader(vobj);
-
-    // バーテックスシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
-    if (printShaderInfoLog(vobj, "vertex shader"))
-      glAttachShader(program, vobj);
-    glDeleteShader(vobj);
-  }
+  // 一つずつ転送するときのユニフォームブロックのサイズ
+  GLint alignment;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  const GLsizeiptr blocksize(((sizeof (Material) - 1) / alignment + 1) * alignment);
 
-  if (fsrc != NULL)
-  {
-    // フラグメントシェーダのシェーダオブジェクトを作成する
-    const GLuint fobj(glCreateShader(GL_FRAGMENT_SHADER));
-    glShaderSource(fobj, 1, &fsrc, NULL);
-    glCompileShader(fobj);
-
-    // フラグメントシェーダのシェーダオブジェクトをプログラムオブジェクトに組み込む
-    if (printShaderInfoLog(fobj, "fragment shader"))
-      glAttachShader(program, fobj);
-    glDeleteShader(fobj);
-  }
+  // 計測を繰り返す回数
+  static constexpr int repeat(16);
 
-  // プログラムオブジェクトをリンクする
-  glBindAttribLocation(program, 0, "position");
-  glBindAttribLocation(program, 1, "normal");
-  glBindFragDataLocation(program, 0, "fragment");
-  glLinkProgram(program);
-
-  // 作成したプログラムオブジェクトを返す
-  if (printProgramInfoLog(program))
-    return program;
+  std::cout << "blocks\tper-block [ms]\tstaged [ms]" << std::endl;
+  for (unsigned int count = 1; count <= 4096; count *= 4)
+  {
+    const std::vector<Material> data(count, Material{ {}, {}, {}, 1.0f });
+
+    // 一つずつ glBufferSubData() で転送する
+    GLuint ubo;
+    glGenBuffers(1, &ubo);
+    State::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, count * blocksize, NULL, GL_STATIC_DRAW);
+    glFinish();
+    const clock::time_point t0(clock::now());
+    for (int r = 0; r < repeat; ++r)
+    {
+      for (unsigned int i = 0; i < count; ++i)
+        glBufferSubData(GL_UNIFORM_BUFFER, i * blocksize, sizeof (Material), &data[i]);
+    }
+    glFinish();
+    const clock::time_point t1(clock::now());
+    State::get().forgetBuffer(ubo);
+    glDeleteBuffers(1, &ubo);
+
+    // CPU 側の写しにまとめて一度に転送する
+    const Uniform<Material> uniform(NULL, count);
+    glFinish();
+    const clock::time_point t2(clock::now());
+    for (int r = 0; r < repeat; ++r)
+    {
+      uniform.set(data.data(), 0, count);
+      uniform.select(0);
+    }
+    glFinish();
+    const clock::time_point t3(clock::now());
 
-  // プログラムオブジェクトが作成できなければ 0 を返す
-  glDeleteProgram(program);
-  return 0;
+    std::cout << count
+      << "\t" << std::chrono::duration<double, std::milli>(t1 - t0).count() / repeat
+      << "\t" << std::chrono::duration<double, std::milli>(t3 - t2).count() / repeat
+      << std::endl;
+  }
 }
 
-// シェーダのソースファイルを読み込む
-//   name: シェーダのソースファイル名
-//   buffer: 読み込んだソースファイルのテキスト
-bool readShaderSource(const char *name, std::vector<GLchar> &buffer)
+// スレッドプールのスレッドの数ごとに変換行列を求める時間を比べる
+void benchmarkJobs()
 {
-  // ファイル名が NULL だった
-  if (name == NULL) return false;
-
-  // ソースファイルを開く
-  std::ifstream file(name, std::ios::binary);
-  if (file.fail())
-  {
-    // 開けなかった
-    std::cerr << "Error: Can't open source file: " << name << std::endl;
-    return false;
-  }
-
-  // ファイルの末尾に移動し現在位置（＝ファイルサイズ）を得る
-  file.seekg(0L, std::ios::end);
-  GLsizei length = static_cast<GLsizei>(file.tellg());
-
-  // ファイルサイズのメモリを確保
-  buffer.resize(length + 1);
+  typedef std::chrono::steady_clock clock;
 
-  // ファイルを先頭から読み込む
-  file.seekg(0L, std::ios::beg);
-  file.read(buffer.data(), length);
-  buffer[length] = '\0';
+  // 変換行列の数と計測を繰り返す回数
+  static constexpr int count(1 << 18), repeat(8);
+  std::vector<Transform> transform(count, Transform(Matrix::identity()));
 
-  if (file.fail())
+  std::cout << "threads\ttime [ms]\tspeedup\tefficiency" << std::endl;
+  const unsigned int cores(std::max(1u, std::thread::hardware_concurrency()));
+  double single(0.0);
+  for (unsigned int threads = 1; threads <= cores; ++threads)
   {
-    // うまく読み込めなかった
-    std::cerr << "Error: Could not read souce file: " << name << std::endl;
-    file.close();
-    return false;
-  }
+    JobSystem jobs(threads);
+    const clock::time_point t0(clock::now());
+    for (int r = 0; r < repeat; ++r)
+    {
+      jobs.parallelFor(0, count, [&transform, r](int begin, int end)
+      {
+        for (int i = begin; i < end; ++i)
+        {
+          const GLfloat a(static_cast<GLfloat>(i + r) * 0.001f);
+          transform[i] = Transform(Matrix::rotate(a, 0.0f, 1.0f, 0.0f)
+            * Matrix::translate(a, 0.0f, 0.0f) * Matrix::scale(1.0f, a + 1.0f, 1.0f), i & 1);
+        }
+      });
+    }
+    const double t(std::chrono::duration<double, std::milli>(clock::now() - t0).count() / repeat);
+    if (threads == 1) single = t;
 
-  // 読み込み成功
-  file.close();
-  return true;
+    std::cout << threads << "\t" << t << "\t" << single / t
+      << "\t" << single / t / threads << std::endl;
+  }
 }
 
-// シェーダのソースファイルを読み込んでプログラムオブジェクトを作成する
-//   vert: バーテックスシェーダのソースファイル名
-//   frag: フラグメントシェーダのソースファイル名
-GLuint loadProgram(const char *vert, const char *frag)
+int main(int argc, char *argv[])
 {
-  // シェーダのソースファイルを読み込む
-  std::vector<GLchar> vsrc;
-  const bool vstat(readShaderSource(vert, vsrc));
-  std::vector<GLchar> fsrc;
-  const bool fstat(readShaderSource(frag, fsrc));
-
-  // プログラムオブジェクトを作成する
-  return vstat && fstat ? createProgram(vsrc.data(), fsrc.data()) : 0;
-}
+  // スレッドプールの伸び具合を計測するだけなら計測して終わる (OpenGL は使わない)
+  if (argc > 1 && strcmp(argv[1], "--benchmark-jobs") == 0)
+  {
+    benchmarkJobs();
+    return 0;
+  }
 
-int main()
-{
   // GLFW を初期化する
   if (glfwInit() == GL_FALSE)
   {
@@ -195,99 +212,165 @@ int main()
   // ウィンドウを作成する
   Window window;
 
+  // uniform ブロックの転送時間を計測するだけなら計測して終わる
+  if (argc > 1 && strcmp(argv[1], "--benchmark-uniform") == 0)
+  {
+    benchmarkUniform();
+    return 0;
+  }
+
   // 背景色を指定する
   glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
 
+  // OpenGL の状態の変更は記録を通して行う
+  State &state(State::get());
+
   // 背面カリングを有効にする
-  glFrontFace(GL_CCW);
-  glCullFace(GL_BACK);
-  glEnable(GL_CULL_FACE);
+  state.frontFace(GL_CCW);
+  state.cullFace(GL_BACK);
+  state.enable(GL_CULL_FACE);
 
   // デプスバッファを有効にする
   glClearDepth(1.0);
-  glDepthFunc(GL_LESS);
-  glEnable(GL_DEPTH_TEST);
-
-  // プログラムオブジェクトを作成する
-  const GLuint program(loadProgram("point.vert", "point.frag"));
+  state.depthFunc(GL_LESS);
+  state.enable(GL_DEPTH_TEST);
 
-  // uniform 変数の場所を取得する
-  const GLint modelviewLoc(glGetUniformLocation(program, "modelview"));
-  const GLint projectionLoc(glGetUniformLocation(program, "projection"));
-  const GLint normalMatrixLoc(glGetUniformLocation(program, "normalMatrix"));
-  const GLint LposLoc(glGetUniformLocation(program, "Lpos"));
-  const GLint LambLoc(glGetUniformLocation(program, "Lamb"));
-  const GLint LdiffLoc(glGetUniformLocation(program, "Ldiff"));
-  const GLint LspecLoc(glGetUniformLocation(program, "Lspec"));
+  // 光源とクラスタのテクスチャは 0 番から 2 番のテクスチャユニットから読む
+  static constexpr GLint lightUnit[] = { 0, 1, 2 };
 
-  // uniform block の場所を取得する
-  const GLint materialLoc(glGetUniformBlockIndex(program, "Material"));
+  // 材質のテクスチャは 3 番のテクスチャユニットから読む
+  static constexpr GLint materialUnit(3);
 
-  // uniform block の場所を 0 番の結合ポイントに結びつける
-  glUniformBlockBinding(program, materialLoc, 0);
-
-  // 球の分割数
-  const int slices(16), stacks(8);
-
-  // 頂点属性を作る
-  std::vector<Object::Vertex> solidSphereVertex;
-
-  for (int j = 0; j <= stacks; ++j)
+  // 組み合わせごとにフレームごとに設定する uniform 変数の番号
+  struct FrameUniform
   {
-    const float t(static_cast<float>(j) / static_cast<float>(stacks));
-    const float y(cos(3.141593f * t)), r(sin(3.141593f * t));
+    int projection, clusterCount, viewport, clusterDepth;
+  };
+  std::map<const Program *, FrameUniform> frameUniform;
 
-    for (int i = 0; i <= slices; ++i)
+  // 組み合わせごとのプログラムオブジェクトを作成したり作り直したりしたときの設定
+  ProgramVariants programs("point.vert", "point.frag", [&frameUniform](Program &program)
+  {
+    // フレームごとに設定する uniform 変数の番号を取り出しておく (なければ -1)
+    const FrameUniform u =
     {
-      const float s(static_cast<float>(i) / static_cast<float>(slices));
-      const float z(r * cos(6.283185f * s)), x(r * sin(6.283185f * s));
+      program.uniform("projection"),
+      program.uniform("clusterCount"),
+      program.uniform("viewport"),
+      program.uniform("clusterDepth")
+    };
+    frameUniform[&program] = u;
+
+    // テクスチャユニットを指定する
+    program.use();
+    program.set(program.uniform("lightData"), lightUnit);
+    program.set(program.uniform("clusterData"), lightUnit + 1);
+    program.set(program.uniform("lightIndex"), lightUnit + 2);
+    program.set(program.uniform("materialData"), &materialUnit);
+
+    // uniform block の場所を 1 番の結合ポイントに結びつける
+    program.bindBlock("Transform", 1);
+
+    // uniform block の実際の配置が C++ の構造体の配置と一致しているか確かめる
+    static const char *const transformNames[] = { "modelview", "normalMatrix", "material" };
+    TransformLayout::verify(program.get(), "Transform", transformNames);
+  });
+
+  // 普通の図形はクラスタごとに選んだ光源で陰影を付ける
+  static constexpr unsigned int litShading(ProgramVariants::Clustered);
+
+  // まとめて描く破片は頂点ごとに材質の番号を持つ
+  static constexpr unsigned int batchShading(ProgramVariants::Clustered
+    | ProgramVariants::VertexMaterial);
+
+  // 遠くの小さな図形は大きな二つの光源だけで陰影を付ける
+  static constexpr unsigned int farShading(ProgramVariants::lights(2));
+
+  // 最初に使うプログラムオブジェクトを作成する (保存したバイナリがあれば使う)
+  const std::chrono::steady_clock::time_point loadStart(std::chrono::steady_clock::now());
+  const Program &program(programs.get(litShading));
+  const ProgramCache::Stats &programCache(ProgramCache::stats());
+  std::cout << "Program load: " << std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - loadStart).count() << " ms ("
+    << (programCache.hits > 0 ? "warm, binary cache hit" : programCache.rejected > 0
+      ? "cold, binary rejected" : "cold, compiled") << ")" << std::endl;
+
+  // シェーダのソースファイルが書き換えられたら作り直す
+  ShaderWatcher watcher;
+  for (const std::string &file : program.getFiles()) watcher.add(file.c_str());
+
+  // 描画ごとの変換行列はフレームごとに使い捨てる領域に割り当てる
+  UniformRing ring;
+
+  // 球の頂点属性とインデックスを作る
+  std::vector<Object::Vertex> solidSphereVertex;
+  std::vector<GLuint> solidSphereIndex;
+  solidSphere(16, 8, solidSphereVertex, solidSphereIndex);
 
-      // 頂点属性
-      const Object::Vertex v = { x, y, z, x, y, z };
+  // 図形データを作成する
+  std::unique_ptr<SolidShapeMeshlet> shape(new SolidShapeMeshlet(3,
+    static_cast<GLsizei>(solidSphereVertex.size()), solidSphereVertex.data(),
+    static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data()));
 
-      // 頂点属性を追加する
-      solidSphereVertex.emplace_back(v);
-    }
-  }
+  // 二つ目の図形は三角形ストリップと三角形のうちインデックスの少ない方で作る
+  std::unique_ptr<const Shape> shape1(SolidShapeStrip::create(3,
+    static_cast<GLsizei>(solidSphereVertex.size()), solidSphereVertex.data(),
+    static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data()));
 
-  // インデックスを作る
-  std::vector<GLuint> solidSphereIndex;
+  // 二つ目の図形は一つ目の図形に隠れていたら描かない
+  static constexpr GLfloat sphereMin[] = { -1.0f, -1.0f, -1.0f };
+  static constexpr GLfloat sphereMax[] = { 1.0f, 1.0f, 1.0f };
+  Occlusion occlusion1(*shape1, sphereMin, sphereMax);
 
-  for (int j = 0; j < stacks; ++j)
-  {
-    const int k((slices + 1) * j);
+  // 周りを回る小さな破片は CPU で変換してまとめて描く
+  std::vector<Object::Vertex> debrisVertex;
+  std::vector<GLuint> debrisIndex;
+  solidSphere(6, 4, debrisVertex, debrisIndex);
+  DynamicBatch debris;
+  const unsigned int debrisMesh(debris.add(
+    static_cast<GLsizei>(debrisVertex.size()), debrisVertex.data(),
+    static_cast<GLsizei>(debrisIndex.size()), debrisIndex.data()));
 
-    for (int i = 0; i < slices; ++i)
-    {
-      // 頂点のインデックス
-      const GLuint k0(k + i);
-      const GLuint k1(k0 + 1);
-      const GLuint k2(k1 + slices);
-      const GLuint k3(k2 + 1);
+  // 内容が同じ図形データは一度だけ転送して共有する
+  MeshRegistry meshes;
 
-      // 左下の三角形
-      solidSphereIndex.emplace_back(k0);
-      solidSphereIndex.emplace_back(k2);
-      solidSphereIndex.emplace_back(k3);
+  // まとめきれないときは個別に描く
+  const SolidShapeIndex debrisShape(meshes.get(3,
+    static_cast<GLsizei>(debrisVertex.size()), debrisVertex.data(),
+    static_cast<GLsizei>(debrisIndex.size()), debrisIndex.data(), 3));
 
-      // 右上の三角形
-      solidSphereIndex.emplace_back(k0);
-      solidSphereIndex.emplace_back(k3);
-      solidSphereIndex.emplace_back(k1);
-    }
-  }
+  // 破片の数
+  static constexpr int debrisCount(64);
 
-  // 図形データを作成する
-  std::unique_ptr<const Shape> shape(new SolidShapeIndex(3,
-    static_cast<GLsizei>(solidSphereVertex.size()), solidSphereVertex.data(),
-    static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data()));
+  // まとめて描く破片の頂点の数の上限を実測で決める
+  programs.get(batchShading).use();
+  debris.calibrate([&ring](const Matrix &m) { ring.select(1, Transform(m)); });
 
   // 光源データ
-  static constexpr int Lcount(2);
-  static constexpr Vector Lpos[] = { 0.0f, 0.0f, 5.0f, 1.0f, 8.0f, 0.0f, 0.0f, 1.0f };
-  static constexpr GLfloat Lamb[] = { 0.2f, 0.1f, 0.1f, 0.1f, 0.1f, 0.1f };
-  static constexpr GLfloat Ldiff[] = { 1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f };
-  static constexpr GLfloat Lspec[] = { 1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f };
+  LightCluster lights;
+  static constexpr LightCluster::Light light[] =
+  {
+    //  position            radius    ambient             diffuse             specular
+    { 0.0f, 0.0f, 5.0f,  100.0f,  0.2f, 0.1f, 0.1f,  1.0f, 0.5f, 0.5f,  1.0f, 0.5f, 0.5f },
+    { 8.0f, 0.0f, 0.0f,  100.0f,  0.1f, 0.1f, 0.1f,  0.9f, 0.9f, 0.9f,  0.9f, 0.9f, 0.9f }
+  };
+  for (const LightCluster::Light &l : light) lights.add(l);
+
+  // 破片の軌道に沿って小さな色つきの光源を並べる
+  static constexpr int smallLights(128);
+  for (int i = 0; i < smallLights; ++i)
+  {
+    const GLfloat a(6.283185f * static_cast<GLfloat>(i) / static_cast<GLfloat>(smallLights));
+    const GLfloat r(0.5f + 0.5f * cos(a)), g(0.5f + 0.5f * cos(a + 2.094395f)),
+      b(0.5f + 0.5f * cos(a + 4.188790f));
+    const GLfloat x(2.5f * cos(a)), z(2.5f * sin(a));
+    const LightCluster::Light l =
+    {
+      x, -0.5f, z,  1.0f,
+      0.0f, 0.0f, 0.0f,  0.4f * r, 0.4f * g, 0.4f * b,  0.4f * r, 0.4f * g, 0.4f * b
+    };
+    lights.add(l);
+  }
 
   // 色データ
   static constexpr Material color[] =
@@ -296,7 +379,106 @@ int main()
     { 0.6f, 0.6f, 0.2f,  0.6f, 0.6f, 0.2f,  0.3f, 0.3f, 0.3f,  30.0f },
     { 0.1f, 0.1f, 0.5f,  0.1f, 0.1f, 0.5f,  0.4f, 0.4f, 0.4f,  60.0f }
   };
-  const Uniform<Material> material(color, 2);
+  MaterialTable materials(color, 2);
+
+  // 材質の番号を頂点属性に持たない図形では番号の既定値 0 を使う
+  glVertexAttribI4i(2, 0, 0, 0, 0);
+
+  // ビュー変換行列を求める (視点は動かない)
+  const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+
+  // 周りに並べた動かない目印は描画命令を一度だけ記録して再生する
+  static constexpr int markerCount(8);
+  std::vector<Transform> markerTransform;
+  std::vector<CommandBuffer::Slot> markerSlot;
+  CommandBuffer markers;
+  for (int i = 0; i < markerCount; ++i)
+  {
+    const GLfloat a(6.283185f * static_cast<GLfloat>(i) / static_cast<GLfloat>(markerCount));
+    const GLfloat x(3.5f * cos(a)), z(3.5f * sin(a));
+    const Matrix m(Matrix::translate(x, -1.0f, z) * Matrix::scale(0.1f, 0.1f, 0.1f));
+    markerTransform.emplace_back(view * m, i & 1);
+
+    // 変換行列の位置はフレームごとに書き換える
+    markerSlot.emplace_back(markers.bindBufferRange(GL_UNIFORM_BUFFER, 1,
+      ring.getBuffer(), 0, sizeof (Transform)));
+    debrisShape.record(markers);
+  }
+
+  // 床に並べた多数の図形は描画命令を複数のスレッドで作る
+  static constexpr int fieldSize(32);
+  DrawList field(1);
+  for (int i = 0; i < fieldSize * fieldSize; ++i) field.add(debrisShape, i & 1, 0.08f);
+
+  // 外周に並べた動かない飾りはワールド座標系に変換して材質ごとにまとめる
+  static constexpr int sceneryCount(24);
+  StaticBatch scenery;
+  std::vector<Handle<Object>> sceneryMesh;
+  for (int i = 0; i < sceneryCount; ++i)
+  {
+    // 飾りは球と破片を交互に置く (同じ図形は登録簿から共有する)
+    const std::vector<Object::Vertex> &v(i & 1 ? debrisVertex : solidSphereVertex);
+    const std::vector<GLuint> &x(i & 1 ? debrisIndex : solidSphereIndex);
+    sceneryMesh.emplace_back(meshes.get(3,
+      static_cast<GLsizei>(v.size()), v.data(), static_cast<GLsizei>(x.size()), x.data(), 3));
+    const SolidShapeIndex piece(sceneryMesh.back());
+
+    const GLfloat a(6.283185f * static_cast<GLfloat>(i) / static_cast<GLfloat>(sceneryCount));
+    const GLfloat s(i & 1 ? 0.2f : 0.3f);
+    scenery.add(piece, Matrix::translate(4.5f * cos(a), -1.2f, 4.5f * sin(a))
+      * Matrix::scale(s, s, s), (i >> 1) & 1);
+  }
+  scenery.build();
+
+  // まとめた後は飾りの図形データを使わない
+  for (const Handle<Object> &mesh : sceneryMesh) meshes.release(mesh);
+
+  // 手前に置いた波打つ格子は書き換えた頂点だけを転送し、行を継ぎ足して大きくする
+  static constexpr int gridColumns(16), gridRows(16), gridStart(8);
+  const Matrix gridModel(Matrix::translate(0.0f, -1.4f, 2.5f) * Matrix::scale(2.0f, 2.0f, 2.0f));
+
+  // 格子の一行分の頂点を作る
+  //   j: 行の番号
+  //   t: 時刻
+  //   row: 頂点属性の格納先
+  const auto gridRow([](int j, GLfloat t, Object::Vertex *row)
+  {
+    const GLfloat z(static_cast<GLfloat>(j) / static_cast<GLfloat>(gridRows - 1) - 0.5f);
+    for (int i = 0; i < gridColumns; ++i)
+    {
+      const GLfloat x(static_cast<GLfloat>(i) / static_cast<GLfloat>(gridColumns - 1) - 0.5f);
+      const GLfloat y(0.05f * sin(12.56637f * (x + z) + t));
+      const Object::Vertex v = { x, y, z, 0.0f, 1.0f, 0.0f };
+      row[i] = v;
+    }
+  });
+
+  // 格子の一つ前の行とつなぐ三角形のインデックスを作る
+  //   j: 行の番号
+  //   index: 頂点のインデックスの格納先
+  const auto gridStrip([](int j, GLuint *index)
+  {
+    for (int i = 0; i < gridColumns - 1; ++i)
+    {
+      const GLuint k0((j - 1) * gridColumns + i), k1(k0 + 1), k2(k0 + gridColumns), k3(k2 + 1);
+      const GLuint triangle[] = { k0, k2, k1, k1, k2, k3 };
+      std::copy(triangle, triangle + 6, index + i * 6);
+    }
+  });
+
+  // 最初は半分の行で作る
+  std::vector<Object::Vertex> gridVertex(gridStart * gridColumns);
+  std::vector<GLuint> gridIndex((gridStart - 1) * (gridColumns - 1) * 6);
+  for (int j = 0; j < gridStart; ++j)
+  {
+    gridRow(j, 0.0f, gridVertex.data() + j * gridColumns);
+    if (j > 0) gridStrip(j, gridIndex.data() + (j - 1) * (gridColumns - 1) * 6);
+  }
+  EditableShape grid(3, static_cast<GLsizei>(gridVertex.size()), gridVertex.data(),
+    static_cast<GLsizei>(gridIndex.size()), gridIndex.data());
+
+  // 描画したフレーム数と三角形の数
+  unsigned long long frames(0), triangles(0);
 
   // タイマーを 0 にセット
   glfwSetTime(0.0);
@@ -307,8 +489,10 @@ int main()
     // ウィンドウを消去する
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // シェーダプログラムの使用開始
-    glUseProgram(program);
+    // シェーダのソースファイルが書き換えられていれば作り直しを始め、
+    // 出来上がるまでは今のプログラムオブジェクトで描き続ける
+    if (watcher.changed()) programs.reload();
+    programs.update();
 
     // 透視投影変換行列を求める
     const GLfloat *const size(window.getSize());
@@ -321,47 +505,260 @@ int main()
     const Matrix r(Matrix::rotate(static_cast<GLfloat>(glfwGetTime()), 0.0f, 1.0f, 0.0f));
     const Matrix model(Matrix::translate(location[0], location[1], 0.0f) * r);
 
-    // ビュー変換行列を求める
-    const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
-
-    // 法線ベクトルの変換行列の格納先
-    GLfloat normalMatrix[9];
-
     // モデルビュー変換行列を求める
     const Matrix modelview(view * model);
 
-    // 法線ベクトルの変換行列を求める
-    modelview.getNormalMatrix(normalMatrix);
+    // クラスタごとに影響する光源を求める
+    lights.update(projection, view, window.getViewport());
+    lights.bind(lightUnit[0]);
 
-    // uniform 変数に値を設定する
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
-    glUniformMatrix4fv(modelviewLoc, 1, GL_FALSE, modelview.data());
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
-    for (int i = 0; i < Lcount; ++i)
-      glUniform4fv(LposLoc + i, 1, (view * Lpos[i]).data());
-    glUniform3fv(LambLoc, Lcount, Lamb);
-    glUniform3fv(LdiffLoc, Lcount, Ldiff);
-    glUniform3fv(LspecLoc, Lcount, Lspec);
+    // 組み合わせに対応するプログラムオブジェクトを使って uniform 変数に値を設定する
+    // (値が変わっていなければ送らない)
+    const auto select([&](unsigned int key)
+    {
+      Program &program(programs.get(key));
+      program.use();
+
+      // 作成に失敗した組み合わせには設定しない
+      const auto found(frameUniform.find(&program));
+      if (found == frameUniform.end()) return;
+      const FrameUniform &u(found->second);
+      program.set(u.projection, projection.data());
+
+      // クラスタの uniform 変数はクラスタを使う組み合わせにしかない
+      if (key & ProgramVariants::Clustered)
+      {
+        program.set(u.clusterCount, lights.getCount());
+        program.set(u.viewport, lights.getViewport());
+        program.set(u.clusterDepth, lights.getDepth());
+      }
+    });
+
+    // 材質の表を結合する
+    materials.bind(materialUnit);
 
     // 図形を描画する
-    material.select(0, 0);
+    select(litShading);
+    ring.select(1, Transform(modelview, 0));
+    shape->cull(projection, modelview);
     shape->draw();
+    triangles += shape->getTriangleCount();
 
     // 二つ目のモデルビュー変換行列を求める
     const Matrix modelview1(modelview * Matrix::translate(0.0f, 0.0f, 3.0f));
 
-    // 二つ目の法線ベクトルの変換行列を求める
-    modelview1.getNormalMatrix(normalMatrix);
+    // 二つ目の図形を描画する
+    ring.select(1, Transform(modelview1, 1));
+    occlusion1.draw(projection, modelview1);
+
+    // 破片のモデル変換行列を求めてまとめて描くものを集める
+    const GLfloat t(static_cast<GLfloat>(glfwGetTime()));
+    debris.clear();
+    for (int i = 0; i < debrisCount; ++i)
+    {
+      const GLfloat a(6.283185f * static_cast<GLfloat>(i) / static_cast<GLfloat>(debrisCount));
+      const Matrix m(Matrix::rotate(a + t * 0.5f, 0.0f, 1.0f, 0.0f)
+        * Matrix::translate(2.0f, 0.5f * sin(a * 3.0f + t), 0.0f)
+        * Matrix::scale(0.05f, 0.05f, 0.05f));
+
+      if (!debris.submit(debrisMesh, m, i & 1))
+      {
+        // 頂点が多すぎるものは個別に描く
+        ring.select(1, Transform(view * m, i & 1));
+        debrisShape.draw();
+      }
+    }
+    debris.update();
+
+    // まとめた破片の頂点はワールド座標系にあり材質の番号は頂点ごとに持つ
+    ring.select(1, Transform(view));
 
-    // uniform 変数に値を設定する
-    glUniformMatrix4fv(modelviewLoc, 1, GL_FALSE, modelview1.data());
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+    // 破片を材質に関わらず一度に描画する
+    select(batchShading);
+    debris.draw();
 
-    // 二つ目の図形を描画する
-    material.select(0, 1);
-    shape->draw();
+    // 動かない飾りを視錐台で選別して材質ごとにまとめて描画する
+    // (頂点はワールド座標系にある)
+    select(litShading);
+    scenery.cull(projection, view);
+    for (std::size_t i = 0; i < scenery.getBatchCount(); ++i)
+    {
+      ring.select(1, Transform(view, scenery.getMaterial(i)));
+      scenery.draw(i);
+    }
+
+    // 格子が全部の行に達するまでときどき行を継ぎ足す
+    int rows(grid.getVertexCount() / gridColumns);
+    Object::Vertex row[gridColumns];
+    if (rows < gridRows && frames % 30 == 29)
+    {
+      GLuint strip[(gridColumns - 1) * 6];
+      gridRow(rows, t, row);
+      grid.addVertex(gridColumns, row);
+      gridStrip(rows, strip);
+      grid.addIndex((gridColumns - 1) * 6, strip);
+      ++rows;
+    }
+
+    // 格子の離れた二行だけを波打たせて書き換えた部分を転送して描画する
+    for (int k = 0; k < 2; ++k)
+    {
+      const int j(static_cast<int>((frames + k * (rows / 2)) % rows));
+      gridRow(j, t, row);
+      grid.setVertex(j * gridColumns, gridColumns, row);
+    }
+    grid.update();
+    ring.select(1, Transform(view * gridModel, 1));
+    grid.draw();
+
+    // 目印の変換行列を今のフレームの領域に書き込んで記録した描画命令を再生する
+    select(farShading);
+    for (int i = 0; i < markerCount; ++i)
+    {
+      const GLintptr where(ring.allocate(&markerTransform[i], sizeof (Transform)));
+      markers.patch(markerSlot[i], ring.getBuffer(), where);
+    }
+    markers.replay();
+
+    // 床に並べた図形のモデル変換行列を求めて選別と描画命令の記録を並列に行い発行する
+    field.build(projection, view, [t](int i)
+    {
+      const GLfloat x(static_cast<GLfloat>(i % fieldSize) * 0.5f - 8.0f);
+      const GLfloat z(static_cast<GLfloat>(i / fieldSize) * 0.5f - 8.0f);
+      return Matrix::translate(x, -1.5f, z)
+        * Matrix::rotate(t + static_cast<GLfloat>(i), 0.0f, 1.0f, 0.0f)
+        * Matrix::scale(0.08f, 0.08f, 0.08f);
+    });
+    field.submit(ring);
+
+    // 変換行列の領域を次のフレームの領域に切り替える
+    ring.frame();
+
+    // ワーカースレッドがメインスレッドに回した OpenGL の仕事を処理する
+    JobSystem::get().drain();
 
     // カラーバッファを入れ替えてイベントを取り出す
     window.swapBuffers();
+    ++frames;
+  }
+
+  // 頂点の溶接で減った頂点と三角形の数を表示する
+  const Weld::Stats &weld(Weld::stats());
+  std::cout << "Welded vertices: " << weld.vertexIn << " -> " << weld.vertexOut
+    << ", triangles: " << weld.primitiveIn << " -> " << weld.primitiveOut << std::endl;
+
+  // 1 フレームあたりに描画した三角形の数を表示する
+  if (frames > 0)
+  {
+    std::cout << "Triangles per frame: " << triangles / frames
+      << " / " << shape->getTotalTriangleCount() << std::endl;
+  }
+
+  // 図形データを転送したバイト数と共有によって転送せずに済んだバイト数を表示する
+  std::cout << "Mesh registry: " << meshes.getUploadedBytes() << " bytes uploaded, "
+    << meshes.getDeduplicatedBytes() << " bytes deduplicated" << std::endl;
+
+  // 三角形ストリップにより減ったインデックスの数を表示する
+  const SolidShapeStrip::Stats &strip(SolidShapeStrip::stats());
+  std::cout << "Indices: " << strip.listIndex << " -> " << strip.chosenIndex << std::endl;
+
+  // まとめて描いた破片の数と描画命令の数を表示する
+  const DynamicBatch::Stats &batch(DynamicBatch::stats());
+  std::cout << "Dynamic batch: " << batch.instances << " instances in "
+    << batch.drawCalls << " draw calls (threshold " << debris.getThreshold()
+    << " vertices)" << std::endl;
+
+  // まとめた動かない図形の数と 1 フレームあたりの描画命令の数を表示する
+  const StaticBatch::Stats &statics(StaticBatch::stats());
+  if (frames > 0)
+  {
+    std::cout << "Static batch: " << scenery.getPartCount() << " shapes in "
+      << scenery.getBatchCount() << " batches, draws per frame: "
+      << static_cast<double>(statics.draws) / frames << ", culled per frame: "
+      << static_cast<double>(statics.culled) / frames << std::endl;
+  }
+
+  // 書き換えられる格子に転送したバイト数を全体を転送し直した場合と比べて表示する
+  const EditableShape::Stats &edit(EditableShape::stats());
+  if (frames > 0)
+  {
+    std::cout << "Editable mesh: " << edit.bytes / frames << " bytes uploaded per frame / "
+      << grid.getVertexCount() * sizeof (Object::Vertex) + grid.getIndexCount() * sizeof (GLuint)
+      << " bytes full, " << edit.uploads / frames << " uploads per frame, "
+      << edit.grows << " grows" << std::endl;
+  }
+
+  // オクルージョンクエリの結果を表示する
+  const Occlusion::Stats &occlusion(Occlusion::stats());
+  std::cout << "Occlusion queries: " << occlusion.queries << " (" << occlusion.proxies
+    << " proxies), hidden: " << occlusion.hidden << std::endl;
+
+  // フレームごとに割り当てた変換行列の数と領域が空くのを待った回数を表示する
+  const UniformRing::Stats &transform(UniformRing::stats());
+  if (frames > 0)
+  {
+    std::cout << "Transform blocks per frame: " << transform.blocks / frames
+      << ", waits: " << transform.waits << std::endl;
+  }
+
+  // 作成したプログラムオブジェクトの組み合わせの数を表示する
+  std::cout << "Program variants: " << programs.size() << std::endl;
+
+  // 値が変わらないので省略した uniform 変数の数を表示する
+  const Program::Stats &uniform(Program::stats());
+  std::cout << "Uniform updates: " << uniform.issued << " issued, "
+    << uniform.elided << " elided" << std::endl;
+  if (uniform.reloads > 0) std::cout << "Shader reloads: " << uniform.reloads << std::endl;
+
+  // フレームあたりに発行した状態の変更と省いた状態の変更の数を表示する
+  const State::Stats &calls(State::stats());
+  if (frames > 0)
+  {
+    std::cout << "State changes per frame: " << calls.issued / frames << " issued, "
+      << calls.skipped / frames << " skipped" << std::endl;
+  }
+
+  // 目印の記録した描画命令を再生した回数を表示する
+  if (markers.getReplayCount() > 0)
+  {
+    std::cout << "Marker commands: " << markers.size() << ", replays: "
+      << markers.getReplayCount() << ", patches per replay: "
+      << markers.getPatchCount() / markers.getReplayCount() << std::endl;
+  }
+
+  // 描画リストを含む全てのコマンドバッファを再生した回数を表示する
+  const CommandBuffer::Stats &replay(CommandBuffer::stats());
+  if (replay.replays > 0)
+  {
+    std::cout << "All command buffers: " << replay.replays << " replays, "
+      << replay.commands << " commands, " << replay.patches << " patches" << std::endl;
+  }
+
+  // 並列に作った描画命令で描いた図形の数を表示する
+  const DrawList::Stats &list(DrawList::stats());
+  if (frames > 0)
+  {
+    std::cout << "Draw list per frame: " << list.visible / frames << " visible, "
+      << list.culled / frames << " culled, " << field.getPartitionCount()
+      << " partitions" << std::endl;
+  }
+
+  // スレッドプールで処理した仕事の数を表示する
+  const JobSystem::Stats &jobs(JobSystem::stats());
+  std::cout << "Jobs: " << jobs.executed << " executed, " << jobs.stolen << " stolen, "
+    << jobs.main << " on the main thread" << std::endl;
+
+  // 材質の表に転送した回数を表示する
+  const MaterialTable::Stats &table(MaterialTable::stats());
+  std::cout << "Material table: " << table.uploads << " uploads, "
+    << table.slots << " slots / " << materials.size() << std::endl;
+
+  // クラスタあたりの光源の数を表示する
+  const LightCluster::Stats &cluster(LightCluster::stats());
+  if (cluster.clusters > 0)
+  {
+    std::cout << "Lights per cluster: "
+      << static_cast<double>(cluster.references) / cluster.clusters
+      << " / " << lights.getLightCount() << ", dropped: " << cluster.dropped << std::endl;
   }
 }
@@ -1,32 +1,14 @@
 #version 150 core
-const int Lcount = 2;
-uniform vec4 Lpos[Lcount];
-uniform vec3 Lamb[Lcount];
-uniform vec3 Ldiff[Lcount];
-uniform vec3 Lspec[Lcount];
-layout (std140) uniform Material
-{
-  vec3 Kamb;
-  vec3 Kdiff;
-  vec3 Kspec;
-  float Kshi;
-};
-in vec3 Idiff;
+uniform samplerBuffer materialData;
 in vec4 P;
 in vec3 N;
+flat in int M;
 out vec4 fragment;
+#include "lighting.glsl"
 void main()
 {
-  vec3 V = -normalize(P.xyz);
-  vec3 Idiff = vec3(0.0);
-  vec3 Ispec = vec3(0.0);
-  for (int i = 0; i < Lcount; ++i)
-  {
-    vec3 L = normalize((Lpos[i] * P.w - P * Lpos[i].w).xyz);
-    vec3 Iamb = Kamb * Lamb[i];
-    Idiff += max(dot(N, L), 0.0) * Kdiff * Ldiff[i] + Iamb;
-    vec3 H = normalize(L + V);
-    Ispec += pow(max(dot(normalize(N), H), 0.0), Kshi) * Kspec * Lspec[i];
-  }
-  fragment = vec4(Idiff + Ispec, 1.0);
+  vec3 Kamb = texelFetch(materialData, M * 3).rgb;
+  vec3 Kdiff = texelFetch(materialData, M * 3 + 1).rgb;
+  vec4 Kspec = texelFetch(materialData, M * 3 + 2);
+  fragment = vec4(shade(Kamb, Kdiff, Kspec, P, N), 1.0);
 }
@@ -1,14 +1,27 @@
 #version 150 core
-uniform mat4 modelview;
 uniform mat4 projection;
-uniform mat3 normalMatrix;
+layout (std140) uniform Transform
+{
+  mat4 modelview;
+  mat3 normalMatrix;
+  int material;
+};
 in vec4 position;
 in vec3 normal;
+#ifdef VERTEX_MATERIAL
+in int materialId;
+#endif
 out vec4 P;
 out vec3 N;
+flat out int M;
 void main()
 {
   P = modelview * position;
   N = normalize(normalMatrix * normal);
+#ifdef VERTEX_MATERIAL
+  M = material + materialId;
+#else
+  M = material;
+#endif
   gl_Position = projection * P;
 }